@@ -0,0 +1,477 @@
+/*
+
+Benchmark of the Wrap message paths.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13972 $ $Date:: 2020-10-13 #$ $Author: serge $
+
+#include <iostream>         // cout
+#include <fstream>          // std::ofstream
+#include <sstream>          // std::ostringstream
+#include <atomic>           // std::atomic
+#include <chrono>           // std::chrono
+#include <functional>       // std::function
+#include <vector>           // std::vector
+#include <cstdlib>          // malloc
+#include <new>              // std::bad_alloc
+
+#include "utils/dummy_logger.h"                 // dummy_logger::set_log_level
+#include "utils/request_id_gen.h"               // RequestIdGen
+
+#include "simple_voip_wrap/wrap.h"              // simple_voip_wrap::Wrap
+#include "simple_voip_wrap/object_factory.h"    // simple_voip::wrap::create_PlayFileRequest
+
+#include "stubs.h"                              // Voip, Callback, Scheduler, GetDuration
+
+// count every heap allocation of the process
+static std::atomic<uint64_t> g_num_allocs( 0 );
+
+void * operator new( size_t size )
+{
+    g_num_allocs.fetch_add( 1, std::memory_order_relaxed );
+
+    auto * res = malloc( size ? size : 1 );
+
+    if( res == nullptr )
+        throw std::bad_alloc();
+
+    return res;
+}
+
+void operator delete( void * p ) noexcept
+{
+    free( p );
+}
+
+void operator delete( void * p, size_t ) noexcept
+{
+    free( p );
+}
+
+namespace benchmark {
+
+struct Result
+{
+    std::string name;
+    uint64_t    num_ops;
+    uint64_t    ns;
+    uint64_t    num_allocs;
+};
+
+// accumulates the time and allocations of the measured sections only
+class Measure
+{
+public:
+    Measure():
+        ns_( 0 ),
+        num_allocs_( 0 ),
+        start_allocs_( 0 )
+    {
+    }
+
+    void start()
+    {
+        start_allocs_   = g_num_allocs.load( std::memory_order_relaxed );
+        start_          = std::chrono::steady_clock::now();
+    }
+
+    void stop()
+    {
+        auto end = std::chrono::steady_clock::now();
+
+        num_allocs_ += g_num_allocs.load( std::memory_order_relaxed ) - start_allocs_;
+        ns_         += std::chrono::duration_cast<std::chrono::nanoseconds>( end - start_ ).count();
+    }
+
+    uint64_t get_ns() const
+    {
+        return ns_;
+    }
+
+    uint64_t get_num_allocs() const
+    {
+        return num_allocs_;
+    }
+
+private:
+    uint64_t    ns_;
+    uint64_t    num_allocs_;
+    uint64_t    start_allocs_;
+
+    std::chrono::steady_clock::time_point   start_;
+};
+
+class Benchmark
+{
+public:
+    Benchmark( const simple_voip_wrap::Config & config ):
+        num_calls_( 1000 ),
+        config_( config ),
+        duration_( is_timing_wheel() ? 0.001 : 10.0 ),
+        gd_( duration_ )
+    {
+    }
+
+    bool init( std::string * error_msg )
+    {
+        return wrap_.init( 0, config_, & voip_, & callback_, & sched_, & req_id_gen_, & gd_, error_msg );
+    }
+
+    void shutdown()
+    {
+        wrap_.shutdown();
+    }
+
+    // one op is the passthrough of a request which is not intercepted
+    void run_forward_passthrough( uint64_t num_ops, Measure * m )
+    {
+        std::vector<const simple_voip::ForwardObject*> reqs;
+
+        for( uint64_t done = 0; done < num_ops; done += num_calls_ )
+        {
+            for( uint32_t i = 0; i < num_calls_; ++i )
+                reqs.push_back( simple_voip::create_initiate_call_request( req_id_gen_.get_next_request_id(), "0123456789" ) );
+
+            m->start();
+
+            for( auto * r : reqs )
+                wrap_.consume( r );
+
+            m->stop();
+
+            reqs.clear();
+
+            voip_.release_all();
+        }
+    }
+
+    // one op is PlayFileRequest and its PlayFileResponse, which sets the stop timer
+    void run_play_request_response( uint64_t num_ops, Measure * m )
+    {
+        run_request_response( num_ops, false, false, m );
+    }
+
+    // one op is RecordFileRequest and its RecordFileResponse
+    void run_record_request_response( uint64_t num_ops, Measure * m )
+    {
+        run_request_response( num_ops, true, false, m );
+    }
+
+    // same as run_play_request_response(), but the requests and the responses are passed with consume_batch()
+    void run_play_request_response_batch( uint64_t num_ops, Measure * m )
+    {
+        run_request_response( num_ops, false, true, m );
+    }
+
+    // one op is the expiry of the stop timer, the stop request and its response,
+    // the scheduler only, the timing wheel expires the timers on its own thread
+    void run_timer_expiry_stop( uint64_t num_ops, Measure * m )
+    {
+        for( uint64_t done = 0; done < num_ops; done += num_calls_ )
+        {
+            start_plays( false, false, nullptr );
+
+            m->start();
+
+            sched_.invoke_all();
+
+            m->stop();
+
+            auto resps = create_stop_responses();
+
+            m->start();
+
+            for( auto * r : resps )
+                wrap_.consume( r );
+
+            m->stop();
+        }
+    }
+
+    // one op is PlayFileRequest answered with ErrorResponse
+    void run_play_error( uint64_t num_ops, Measure * m )
+    {
+        run_request_failure( num_ops, false, m );
+    }
+
+    // one op is PlayFileRequest answered with RejectResponse
+    void run_play_reject( uint64_t num_ops, Measure * m )
+    {
+        run_request_failure( num_ops, true, m );
+    }
+
+private:
+
+    bool is_timing_wheel() const
+    {
+        return config_.timer_tick_ms > 0;
+    }
+
+    void run_request_response( uint64_t num_ops, bool is_record, bool is_batch, Measure * m )
+    {
+        for( uint64_t done = 0; done < num_ops; done += num_calls_ )
+        {
+            start_plays( is_record, is_batch, m );
+
+            // stop the media, not measured, the timing wheel fires on its own after the short duration
+            if( is_timing_wheel() == false )
+                sched_.invoke_all();
+
+            auto resps = create_stop_responses();
+
+            for( auto * r : resps )
+                wrap_.consume( r );
+        }
+    }
+
+    void start_plays( bool is_record, bool is_batch, Measure * m )
+    {
+        std::vector<const simple_voip::ForwardObject*>  reqs;
+        std::vector<const simple_voip::CallbackObject*> resps;
+
+        for( uint32_t i = 0; i < num_calls_; ++i )
+        {
+            auto req_id = req_id_gen_.get_next_request_id();
+
+            if( is_record )
+            {
+                reqs.push_back( simple_voip::wrap::create_RecordFileRequest( req_id, i, "rec.wav", duration_ ) );
+                resps.push_back( create_response<simple_voip::RecordFileResponse>( req_id ) );
+            }
+            else
+            {
+                reqs.push_back( simple_voip::wrap::create_PlayFileRequest( req_id, i, "play.wav" ) );
+                resps.push_back( create_response<simple_voip::PlayFileResponse>( req_id ) );
+            }
+        }
+
+        if( m )
+            m->start();
+
+        if( is_batch )
+        {
+            wrap_.consume_batch( reqs.data(), reqs.size() );
+            wrap_.consume_batch( resps.data(), resps.size() );
+        }
+        else
+        {
+            for( uint32_t i = 0; i < num_calls_; ++i )
+            {
+                wrap_.consume( reqs[ i ] );
+                wrap_.consume( resps[ i ] );
+            }
+        }
+
+        if( m )
+            m->stop();
+
+        voip_.release_all();
+    }
+
+    std::vector<const simple_voip::CallbackObject*> create_stop_responses()
+    {
+        std::vector<const simple_voip::CallbackObject*> res;
+
+        auto reqs = voip_.take_stop_requests( num_calls_ );
+
+        for( auto * r : reqs )
+        {
+            if( typeid( * r ) == typeid( simple_voip::PlayFileStopRequest ) )
+                res.push_back( create_response<simple_voip::PlayFileStopResponse>( static_cast<const simple_voip::PlayFileStopRequest*>( r )->req_id ) );
+            else if( typeid( * r ) == typeid( simple_voip::RecordFileStopRequest ) )
+                res.push_back( create_response<simple_voip::RecordFileStopResponse>( static_cast<const simple_voip::RecordFileStopRequest*>( r )->req_id ) );
+
+            delete r;
+        }
+
+        return res;
+    }
+
+    void run_request_failure( uint64_t num_ops, bool is_reject, Measure * m )
+    {
+        std::vector<const simple_voip::ForwardObject*>  reqs;
+        std::vector<const simple_voip::CallbackObject*> resps;
+
+        for( uint64_t done = 0; done < num_ops; done += num_calls_ )
+        {
+            for( uint32_t i = 0; i < num_calls_; ++i )
+            {
+                auto req_id = req_id_gen_.get_next_request_id();
+
+                reqs.push_back( simple_voip::wrap::create_PlayFileRequest( req_id, i, "play.wav" ) );
+
+                if( is_reject )
+                    resps.push_back( create_response<simple_voip::RejectResponse>( req_id ) );
+                else
+                    resps.push_back( create_response<simple_voip::ErrorResponse>( req_id ) );
+            }
+
+            m->start();
+
+            for( uint32_t i = 0; i < num_calls_; ++i )
+            {
+                wrap_.consume( reqs[ i ] );
+                wrap_.consume( resps[ i ] );
+            }
+
+            m->stop();
+
+            reqs.clear();
+            resps.clear();
+
+            voip_.release_all();
+        }
+    }
+
+private:
+
+    uint32_t                    num_calls_;     // ops per batch, each on its own call
+
+    simple_voip_wrap::Config    config_;
+    double                      duration_;      // of plays and records
+
+    Voip                        voip_;
+    Callback                    callback_;
+    Scheduler                   sched_;
+    GetDuration                 gd_;
+    utils::RequestIdGen         req_id_gen_;
+
+    simple_voip_wrap::Wrap      wrap_;
+};
+
+typedef void (Benchmark::*PPMF)( uint64_t num_ops, Measure * m );
+
+Result run( const std::string & name, PPMF func, uint64_t num_ops, const simple_voip_wrap::Config & config = simple_voip_wrap::Config() )
+{
+    Benchmark b( config );
+
+    std::string error_msg;
+
+    if( b.init( & error_msg ) == false )
+    {
+        std::cerr << "cannot initialize Wrap: " << error_msg << std::endl;
+        exit( EXIT_FAILURE );
+    }
+
+    Measure warm_up;
+
+    (b.*func)( num_ops / 10, & warm_up );
+
+    Measure m;
+
+    (b.*func)( num_ops, & m );
+
+    b.shutdown();
+
+    Result res = { name, num_ops, m.get_ns(), m.get_num_allocs() };
+
+    return res;
+}
+
+std::string to_json( const std::vector<Result> & results )
+{
+    std::ostringstream os;
+
+    os << "{\n  \"benchmarks\": [\n";
+
+    for( size_t i = 0; i < results.size(); ++i )
+    {
+        auto & r = results[ i ];
+
+        os << "    { \"name\": \"" << r.name << "\""
+                << ", \"ops\": " << r.num_ops
+                << ", \"ns_per_op\": " << double( r.ns ) / r.num_ops
+                << ", \"allocs_per_op\": " << double( r.num_allocs ) / r.num_ops
+                << " }" << ( i + 1 < results.size() ? "," : "" ) << "\n";
+    }
+
+    os << "  ]\n}\n";
+
+    return os.str();
+}
+
+} // namespace benchmark
+
+int main( int argc, char **argv )
+{
+    uint64_t num_ops = 100000;
+
+    std::string output_file;
+
+    if( argc > 1 )
+        num_ops = std::stoull( argv[1] );
+
+    if( argc > 2 )
+        output_file = argv[2];
+
+    if( num_ops < 1000 )
+        num_ops = 1000;
+
+    // ops are done in batches of 1000
+    num_ops = num_ops / 1000 * 1000;
+
+    dummy_logger::set_log_level( log_levels_log4j::FATAL );
+
+    std::vector<benchmark::Result> results;
+
+    results.push_back( benchmark::run( "forward_passthrough",       & benchmark::Benchmark::run_forward_passthrough, num_ops ) );
+    results.push_back( benchmark::run( "play_request_response",     & benchmark::Benchmark::run_play_request_response, num_ops ) );
+    results.push_back( benchmark::run( "record_request_response",   & benchmark::Benchmark::run_record_request_response, num_ops ) );
+    results.push_back( benchmark::run( "timer_expiry_stop",         & benchmark::Benchmark::run_timer_expiry_stop, num_ops ) );
+    results.push_back( benchmark::run( "play_error_response",       & benchmark::Benchmark::run_play_error, num_ops ) );
+    results.push_back( benchmark::run( "play_reject_response",      & benchmark::Benchmark::run_play_reject, num_ops ) );
+
+    simple_voip_wrap::Config sharded;
+
+    sharded.num_shards  = 16;
+
+    results.push_back( benchmark::run( "play_request_response_sharded",     & benchmark::Benchmark::run_play_request_response, num_ops, sharded ) );
+    results.push_back( benchmark::run( "play_request_response_batch",       & benchmark::Benchmark::run_play_request_response_batch, num_ops, sharded ) );
+    results.push_back( benchmark::run( "timer_expiry_stop_sharded",         & benchmark::Benchmark::run_timer_expiry_stop, num_ops, sharded ) );
+
+    simple_voip_wrap::Config wheel;
+
+    wheel.num_shards    = 16;
+    wheel.timer_tick_ms = 1;
+
+    results.push_back( benchmark::run( "play_request_response_wheel",       & benchmark::Benchmark::run_play_request_response, num_ops, wheel ) );
+    results.push_back( benchmark::run( "record_request_response_wheel",     & benchmark::Benchmark::run_record_request_response, num_ops, wheel ) );
+    results.push_back( benchmark::run( "play_request_response_batch_wheel", & benchmark::Benchmark::run_play_request_response_batch, num_ops, wheel ) );
+
+    auto json = benchmark::to_json( results );
+
+    if( output_file.empty() )
+    {
+        std::cout << json;
+    }
+    else
+    {
+        std::ofstream os( output_file );
+
+        os << json;
+
+        if( os.fail() )
+        {
+            std::cerr << "cannot write " << output_file << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    return 0;
+}
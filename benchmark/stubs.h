@@ -0,0 +1,215 @@
+/*
+
+Benchmark stubs.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13972 $ $Date:: 2020-10-13 #$ $Author: serge $
+
+#ifndef SIMPLE_VOIP_WRAP__BENCHMARK__STUBS_H
+#define SIMPLE_VOIP_WRAP__BENCHMARK__STUBS_H
+
+#include <vector>                               // std::vector
+#include <utility>                              // std::pair
+#include <mutex>                                // std::mutex
+#include <condition_variable>                   // std::condition_variable
+#include <typeinfo>                             // typeid
+
+#include "simple_voip/objects.h"
+#include "simple_voip/object_factory.h"         // init_req_id
+#include "simple_voip/i_simple_voip.h"          // simple_voip::ISimpleVoip
+#include "simple_voip/i_simple_voip_callback.h" // simple_voip::ISimpleVoipCallback
+#include "scheduler/i_scheduler.h"              // IScheduler
+
+#include "simple_voip_wrap/i_get_duration.h"    // IGetDuration
+
+namespace benchmark {
+
+template <class T>
+T * create_response( uint32_t req_id )
+{
+    auto * res = new T;
+
+    simple_voip::init_req_id( res, req_id );
+
+    return res;
+}
+
+// engine, keeps the requests until the benchmark releases them, the stop requests are kept apart,
+// as with the timing wheel they come from the timer thread
+class Voip: virtual public simple_voip::ISimpleVoip
+{
+public:
+    void consume( const simple_voip::ForwardObject * req ) override
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+
+        if( typeid( * req ) == typeid( simple_voip::PlayFileStopRequest )
+                || typeid( * req ) == typeid( simple_voip::RecordFileStopRequest ) )
+        {
+            stop_requests_.push_back( req );
+
+            cond_.notify_one();
+            return;
+        }
+
+        requests_.push_back( req );
+    }
+
+    void release_all()
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+
+        for( auto * r : requests_ )
+            delete r;
+
+        requests_.clear();
+    }
+
+    // waits until at least num stop requests have arrived and takes them
+    std::vector<const simple_voip::ForwardObject*> take_stop_requests( size_t num )
+    {
+        std::unique_lock<std::mutex> lock( mutex_ );
+
+        cond_.wait( lock, [&]() { return stop_requests_.size() >= num; } );
+
+        std::vector<const simple_voip::ForwardObject*> res;
+
+        res.swap( stop_requests_ );
+
+        return res;
+    }
+
+private:
+
+    std::mutex                  mutex_;
+    std::condition_variable     cond_;
+
+    std::vector<const simple_voip::ForwardObject*>  requests_;
+    std::vector<const simple_voip::ForwardObject*>  stop_requests_;
+};
+
+// application, releases the notifications immediately
+class Callback: virtual public simple_voip::ISimpleVoipCallback
+{
+public:
+    Callback():
+        num_received( 0 )
+    {
+    }
+
+    void consume( const simple_voip::CallbackObject * obj ) override
+    {
+        ++num_received;
+
+        delete obj;
+    }
+
+    uint64_t    num_received;
+};
+
+// scheduler, runs the jobs only when asked to
+class Scheduler: virtual public scheduler::IScheduler
+{
+public:
+    Scheduler():
+        last_job_id_( 0 )
+    {
+    }
+
+    ~Scheduler()
+    {
+        for( auto & j : jobs_ )
+            delete j.second;
+    }
+
+    bool insert_job( scheduler::job_id_t * job_id, scheduler::IJob * job, std::string * /* error_msg */ ) override
+    {
+        * job_id = ++last_job_id_;
+
+        jobs_.push_back( std::make_pair( * job_id, job ) );
+
+        return true;
+    }
+
+    bool delete_job( scheduler::job_id_t job_id, std::string * error_msg ) override
+    {
+        for( auto & j : jobs_ )
+        {
+            if( j.first == job_id )
+            {
+                delete j.second;
+
+                j = jobs_.back();
+                jobs_.pop_back();
+
+                return true;
+            }
+        }
+
+        * error_msg = "job not found";
+
+        return false;
+    }
+
+    void invoke_all()
+    {
+        std::vector<std::pair<scheduler::job_id_t, scheduler::IJob*>> jobs;
+
+        jobs.swap( jobs_ );
+
+        for( auto & j : jobs )
+        {
+            j.second->invoke();
+
+            delete j.second;
+        }
+    }
+
+    size_t size() const
+    {
+        return jobs_.size();
+    }
+
+private:
+
+    scheduler::job_id_t     last_job_id_;
+
+    std::vector<std::pair<scheduler::job_id_t, scheduler::IJob*>>   jobs_;
+};
+
+class GetDuration: virtual public simple_voip_wrap::IGetDuration
+{
+public:
+    GetDuration( double duration ):
+        duration_( duration )
+    {
+    }
+
+    double get_duration( const std::string & /* filename */ ) override
+    {
+        return duration_;
+    }
+
+private:
+    double  duration_;
+};
+
+} // namespace benchmark
+
+#endif  // SIMPLE_VOIP_WRAP__BENCHMARK__STUBS_H
@@ -0,0 +1,268 @@
+/*
+
+Simple VOIP Wrap. Caching Duration Getter.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13981 $ $Date:: 2020-10-20 #$ $Author: serge $
+
+#include "caching_duration_getter.h"    // self
+
+#include <sys/stat.h>                   // stat
+
+#include "utils/mutex_helper.h"         // MUTEX_SCOPE_LOCK
+
+namespace simple_voip_wrap {
+
+CachingDurationGetter::CachingDurationGetter():
+    gd_( nullptr ),
+    max_size_( 0 ),
+    must_validate_( true ),
+    generation_( 0 ),
+    stats_( { 0, 0, 0, 0, 0 } )
+{
+}
+
+CachingDurationGetter::~CachingDurationGetter()
+{
+}
+
+bool CachingDurationGetter::init(
+        IGetDuration                        * gd,
+        uint32_t                            max_size,
+        bool                                must_validate,
+        std::string                         * error_msg )
+{
+    if( gd == nullptr )
+    {
+        * error_msg = "gd is null";
+        return false;
+    }
+
+    if( max_size == 0 )
+    {
+        * error_msg = "max_size is 0";
+        return false;
+    }
+
+    MUTEX_SCOPE_LOCK( mutex_ );
+
+    if( gd_ != nullptr )
+    {
+        * error_msg = "already initialized";
+        return false;
+    }
+
+    gd_             = gd;
+    max_size_       = max_size;
+    must_validate_  = must_validate;
+
+    map_filename_to_entry_.reserve( max_size );
+
+    return true;
+}
+
+double CachingDurationGetter::get_duration( const std::string & filename )
+{
+    return get_duration_hashed( filename, std::hash<std::string>()( filename ) );
+}
+
+double CachingDurationGetter::get_duration_hashed( const std::string & filename, size_t hash )
+{
+    FileStamp stamp = { { 0, 0 }, 0 };
+
+    // stat is done without lock, it is the only syscall on the hit path, none if validation is disabled
+    if( must_validate_ && get_file_stamp( & stamp, filename ) == false )
+    {
+        // the file is not accessible, don't cache the result
+        return gd_->get_duration( filename );
+    }
+
+    uint64_t generation;
+
+    {
+        MUTEX_SCOPE_LOCK( mutex_ );
+
+        auto it = map_filename_to_entry_.find( Key { & filename, hash } );
+
+        if( it != map_filename_to_entry_.end() )
+        {
+            auto & e = * it->second;
+
+            if( e.stamp == stamp )
+            {
+                ++stats_.hits;
+
+                lru_.splice( lru_.begin(), lru_, it->second );
+
+                return e.duration;
+            }
+
+            ++stats_.invalidations;
+
+            erase( it );
+        }
+
+        ++stats_.misses;
+
+        generation  = generation_;
+    }
+
+    // inner getter opens the file, so it is called without lock
+    auto duration = gd_->get_duration( filename );
+
+    insert( filename, hash, stamp, duration, generation );
+
+    return duration;
+}
+
+bool CachingDurationGetter::invalidate( const std::string & filename )
+{
+    MUTEX_SCOPE_LOCK( mutex_ );
+
+    ++generation_;
+
+    auto it = map_filename_to_entry_.find( Key { & filename, std::hash<std::string>()( filename ) } );
+
+    if( it == map_filename_to_entry_.end() )
+        return false;
+
+    ++stats_.invalidations;
+
+    erase( it );
+
+    return true;
+}
+
+uint32_t CachingDurationGetter::invalidate_prefix( const std::string & prefix )
+{
+    MUTEX_SCOPE_LOCK( mutex_ );
+
+    ++generation_;
+
+    uint32_t res = 0;
+
+    // rare event (directory moved or deleted), so a full scan is fine
+    for( auto it = map_filename_to_entry_.begin(); it != map_filename_to_entry_.end(); )
+    {
+        auto & filename = * it->first.filename;
+
+        if( filename.compare( 0, prefix.size(), prefix ) == 0 )
+        {
+            auto it_lru = it->second;
+
+            it = map_filename_to_entry_.erase( it );
+            lru_.erase( it_lru );
+
+            ++res;
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    stats_.invalidations += res;
+
+    return res;
+}
+
+void CachingDurationGetter::invalidate_all()
+{
+    MUTEX_SCOPE_LOCK( mutex_ );
+
+    ++generation_;
+
+    stats_.invalidations += map_filename_to_entry_.size();
+
+    map_filename_to_entry_.clear();
+    lru_.clear();
+}
+
+CachingDurationGetter::Stats CachingDurationGetter::get_stats() const
+{
+    MUTEX_SCOPE_LOCK( mutex_ );
+
+    auto res = stats_;
+
+    res.size    = map_filename_to_entry_.size();
+
+    return res;
+}
+
+bool CachingDurationGetter::get_file_stamp( FileStamp * res, const std::string & filename )
+{
+    struct stat st;
+
+    if( stat( filename.c_str(), & st ) != 0 )
+        return false;
+
+    res->mtime  = st.st_mtim;
+    res->size   = st.st_size;
+
+    return true;
+}
+
+void CachingDurationGetter::insert( const std::string & filename, size_t hash, const FileStamp & stamp, double duration, uint64_t generation )
+{
+    MUTEX_SCOPE_LOCK( mutex_ );
+
+    // the file may have changed while it was probed, any invalidation counts, they are rare
+    if( generation != generation_ )
+        return;
+
+    auto it = map_filename_to_entry_.find( Key { & filename, hash } );
+
+    if( it != map_filename_to_entry_.end() )
+    {
+        // another thread has probed the same file in the meantime
+        auto & e = * it->second;
+
+        e.stamp     = stamp;
+        e.duration  = duration;
+
+        lru_.splice( lru_.begin(), lru_, it->second );
+
+        return;
+    }
+
+    if( map_filename_to_entry_.size() >= max_size_ )
+    {
+        auto & last = lru_.back();
+
+        erase( map_filename_to_entry_.find( Key { & last.filename, last.hash } ) );
+
+        ++stats_.evictions;
+    }
+
+    lru_.push_front( Entry { filename, hash, stamp, duration } );
+
+    map_filename_to_entry_.insert( std::make_pair( Key { & lru_.front().filename, hash }, lru_.begin() ) );
+}
+
+// private: mutex must be locked
+void CachingDurationGetter::erase( MapFilenameToEntry::iterator it )
+{
+    auto it_lru = it->second;
+
+    // key points into the list element, so the map entry goes first
+    map_filename_to_entry_.erase( it );
+    lru_.erase( it_lru );
+}
+
+} // namespace simple_voip_wrap
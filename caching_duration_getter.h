@@ -0,0 +1,156 @@
+/*
+
+Simple VOIP Wrap. Caching Duration Getter.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13981 $ $Date:: 2020-10-20 #$ $Author: serge $
+
+#ifndef SIMPLE_VOIP_WRAP__CACHING_DURATION_GETTER_H
+#define SIMPLE_VOIP_WRAP__CACHING_DURATION_GETTER_H
+
+#include <mutex>                            // std::mutex
+#include <list>                             // std::list
+#include <unordered_map>                    // std::unordered_map
+#include <cstdint>                          // uint32_t
+#include <ctime>                            // timespec
+#include <sys/types.h>                      // off_t
+
+#include "i_get_duration.h"                 // IGetDuration
+
+namespace simple_voip_wrap {
+
+/**
+ * @brief Bounded LRU cache in front of another IGetDuration.
+ *
+ * Entries are keyed by filename. With validation enabled a hit is checked against the file's mtime and size,
+ * so a file replaced in place is probed again. Without validation a hit doesn't do any syscalls and the owner
+ * has to call invalidate() for the changed files, see DurationCacheWatcher. Thread-safe.
+ */
+class CachingDurationGetter: virtual public IGetDuration
+{
+public:
+
+    struct Stats
+    {
+        uint64_t    hits;
+        uint64_t    misses;
+        uint64_t    evictions;
+        uint64_t    invalidations;      // stale on lookup or removed by invalidate()
+        uint32_t    size;
+    };
+
+public:
+    CachingDurationGetter();
+    ~CachingDurationGetter();
+
+    bool init(
+            IGetDuration                        * gd,
+            uint32_t                            max_size,
+            bool                                must_validate,
+            std::string                         * error_msg );
+
+    // interface IGetDuration
+    double get_duration( const std::string & filename ) override;
+    double get_duration_hashed( const std::string & filename, size_t hash ) override;
+
+    // returns false if the file is not cached, a probe in progress for the file won't be cached
+    bool invalidate( const std::string & filename );
+
+    // removes the files whose names start with prefix, returns the number of removed files
+    uint32_t invalidate_prefix( const std::string & prefix );
+
+    void invalidate_all();
+
+    Stats get_stats() const;
+
+private:
+
+    struct FileStamp
+    {
+        timespec    mtime;
+        off_t       size;
+
+        bool operator==( const FileStamp & r ) const
+        {
+            return mtime.tv_sec == r.mtime.tv_sec && mtime.tv_nsec == r.mtime.tv_nsec && size == r.size;
+        }
+    };
+
+    struct Entry
+    {
+        std::string filename;
+        size_t      hash;
+        FileStamp   stamp;
+        double      duration;
+    };
+
+    typedef std::list<Entry>    ListEntry;
+
+    // hash is computed once per lookup or passed by the caller
+    struct Key
+    {
+        const std::string   * filename;
+        size_t              hash;
+    };
+
+    struct HashKey
+    {
+        size_t operator()( const Key & k ) const
+        {
+            return k.hash;
+        }
+    };
+
+    struct EqualKey
+    {
+        bool operator()( const Key & l, const Key & r ) const
+        {
+            return l.hash == r.hash && * l.filename == * r.filename;
+        }
+    };
+
+    // key points to Entry::filename of the list element, so the name is stored only once
+    typedef std::unordered_map<Key, ListEntry::iterator, HashKey, EqualKey>    MapFilenameToEntry;
+
+private:
+
+    static bool get_file_stamp( FileStamp * res, const std::string & filename );
+
+    void insert( const std::string & filename, size_t hash, const FileStamp & stamp, double duration, uint64_t generation );
+
+    void erase( MapFilenameToEntry::iterator it );
+
+private:
+    mutable std::mutex          mutex_;
+
+    IGetDuration                * gd_;
+    uint32_t                    max_size_;
+    bool                        must_validate_;
+
+    uint64_t                    generation_;    // incremented on each invalidation
+
+    ListEntry                   lru_;           // most recently used first
+    MapFilenameToEntry          map_filename_to_entry_;
+
+    Stats                       stats_;
+};
+
+} // namespace simple_voip_wrap
+
+#endif  // SIMPLE_VOIP_WRAP__CACHING_DURATION_GETTER_H
@@ -0,0 +1,93 @@
+/*
+
+Simple VOIP Wrap. Config.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13976 $ $Date:: 2020-10-15 #$ $Author: serge $
+
+#ifndef SIMPLE_VOIP_WRAP__CONFIG_H
+#define SIMPLE_VOIP_WRAP__CONFIG_H
+
+#include <cstdint>                          // uint32_t
+
+namespace simple_voip_wrap {
+
+struct Config
+{
+    Config():
+        duration_threads( 0 ),
+        num_shards( 1 ),
+        max_pending_requests( 4096 ),
+        timer_tick_ms( 0 ),
+        max_filenames( 0 ),
+        max_queued_media( 0 ),
+        pending_ttl_ms( 0 ),
+        lock_profiling( false ),
+        speculative_stop_timers( false )
+    {
+    }
+
+    // number of threads resolving play durations in parallel with the play request,
+    // 0 - duration is resolved synchronously when the request is consumed, on the calling thread,
+    // before the shard is locked; a failed lookup rejects the request with DURATION_UNAVAILABLE
+    uint32_t    duration_threads;
+
+    // number of shards the pending state is split into, the shard is chosen by call_id,
+    // so messages of different calls are processed in parallel and messages of one call in order
+    uint32_t    num_shards;
+
+    // maximal number of requests in flight per shard, the pending request table is allocated
+    // for this size at init, requests above the limit are answered with TOO_MANY_REQUESTS
+    uint32_t    max_pending_requests;
+
+    // resolution of Wrap's own timing wheel for stop timers, the wheel is driven by a dedicated thread,
+    // 0 - each stop timer is a separate job of the scheduler
+    uint32_t    timer_tick_ms;
+
+    // maximal number of play filenames interned by Wrap, see Wrap::intern_filename(), interned filenames
+    // are never removed, so this is meant for a bounded set of prompts, the files played after the limit
+    // is reached are not interned, files of play lists are never interned, 0 - interning is disabled
+    uint32_t    max_filenames;
+
+    // plays and records of a call are run one after another, a request which arrives while another one
+    // is in progress is queued and sent to the engine when the previous one has stopped, the queue is flushed
+    // with CALL_ENDED when the call is dropped or lost, requests above the limit are answered with QUEUE_FULL,
+    // 0 - requests are sent to the engine immediately
+    uint32_t    max_queued_media;
+
+    // a request which hasn't got a response from the engine within this time is removed, the application gets
+    // PlayFileStopped or RecordFileStopped with REQUEST_TIMEOUT, the same applies to an acked play, which waits
+    // for its duration longer than this, and is stopped in the engine, the pending table is swept in small steps
+    // from the timer thread, which is started for this if the timing wheel is disabled, an expired request is
+    // kept as a tombstone for another ttl, a late response to it is swallowed, and a play or record which
+    // the engine has started late is stopped, so a tombstone takes a slot of max_pending_requests, 0 - no limit
+    uint32_t    pending_ttl_ms;
+
+    // measure wait and hold time of the shard mutexes, see Wrap::get_lock_stats()
+    bool        lock_profiling;
+
+    // arm the stop timer when the request is sent, using the average ack latency,
+    // and correct the deadline when the ack arrives, the timer is cancelled on error,
+    // false - the timer is armed when the ack arrives
+    bool        speculative_stop_timers;
+};
+
+} // namespace simple_voip_wrap
+
+#endif  // SIMPLE_VOIP_WRAP__CONFIG_H
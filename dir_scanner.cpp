@@ -0,0 +1,143 @@
+/*
+
+Simple VOIP Wrap. Directory Scanner.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13981 $ $Date:: 2020-10-20 #$ $Author: serge $
+
+#include "dir_scanner.h"                // self
+
+#include <dirent.h>                     // opendir
+#include <sys/stat.h>                   // stat, lstat
+
+namespace simple_voip_wrap {
+
+static bool has_extension( const std::string & name, const std::string & extension )
+{
+    return name.size() >= extension.size() && name.compare( name.size() - extension.size(), extension.size(), extension ) == 0;
+}
+
+static unsigned char get_type( const struct dirent * e, const std::string & path )
+{
+    // not all file systems fill d_type
+    if( e->d_type != DT_UNKNOWN )
+        return e->d_type;
+
+    struct stat st;
+
+    if( lstat( path.c_str(), & st ) != 0 )
+        return DT_UNKNOWN;
+
+    return S_ISDIR( st.st_mode ) ? DT_DIR : ( S_ISREG( st.st_mode ) ? DT_REG : ( S_ISLNK( st.st_mode ) ? DT_LNK : DT_UNKNOWN ) );
+}
+
+bool scan_directory( std::vector<std::string> * files, const std::string & dir, const std::string & extension, std::string * error_msg )
+{
+    auto * d = opendir( dir.c_str() );
+
+    if( d == nullptr )
+    {
+        * error_msg = "cannot open directory " + dir;
+        return false;
+    }
+
+    auto prefix = ( dir.empty() == false && dir.back() == '/' ) ? dir : dir + "/";
+
+    std::vector<std::string> subdirs;
+
+    while( auto * e = readdir( d ) )
+    {
+        std::string name( e->d_name );
+
+        if( name == "." || name == ".." )
+            continue;
+
+        auto path = prefix + name;
+
+        auto type = get_type( e, path );
+
+        // links to files are taken as files
+        if( type == DT_LNK )
+        {
+            struct stat st;
+
+            if( stat( path.c_str(), & st ) != 0 || S_ISREG( st.st_mode ) == false )
+                continue;
+
+            type = DT_REG;
+        }
+
+        if( type == DT_DIR )
+            subdirs.push_back( path );
+        else if( type == DT_REG && has_extension( name, extension ) )
+            files->push_back( path );
+    }
+
+    closedir( d );
+
+    for( auto & s : subdirs )
+    {
+        if( scan_directory( files, s, extension, error_msg ) == false )
+            return false;
+    }
+
+    return true;
+}
+
+bool scan_subdirectories( std::vector<std::string> * dirs, const std::string & dir, std::string * error_msg )
+{
+    auto * d = opendir( dir.c_str() );
+
+    if( d == nullptr )
+    {
+        * error_msg = "cannot open directory " + dir;
+        return false;
+    }
+
+    dirs->push_back( dir );
+
+    auto prefix = ( dir.empty() == false && dir.back() == '/' ) ? dir : dir + "/";
+
+    std::vector<std::string> subdirs;
+
+    while( auto * e = readdir( d ) )
+    {
+        std::string name( e->d_name );
+
+        if( name == "." || name == ".." )
+            continue;
+
+        auto path = prefix + name;
+
+        if( get_type( e, path ) == DT_DIR )
+            subdirs.push_back( path );
+    }
+
+    closedir( d );
+
+    for( auto & s : subdirs )
+    {
+        if( scan_subdirectories( dirs, s, error_msg ) == false )
+            return false;
+    }
+
+    return true;
+}
+
+} // namespace simple_voip_wrap
@@ -0,0 +1,41 @@
+/*
+
+Simple VOIP Wrap. Directory Scanner.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13981 $ $Date:: 2020-10-20 #$ $Author: serge $
+
+#ifndef SIMPLE_VOIP_WRAP__DIR_SCANNER_H
+#define SIMPLE_VOIP_WRAP__DIR_SCANNER_H
+
+#include <string>                           // std::string
+#include <vector>                           // std::vector
+
+namespace simple_voip_wrap {
+
+// appends the files of the directory tree whose names end with the extension, empty extension - all files,
+// the paths start with dir, links to files are included, links to directories are not followed
+bool scan_directory( std::vector<std::string> * files, const std::string & dir, const std::string & extension, std::string * error_msg );
+
+// appends dir and all directories of its tree, links to directories are not followed
+bool scan_subdirectories( std::vector<std::string> * dirs, const std::string & dir, std::string * error_msg );
+
+} // namespace simple_voip_wrap
+
+#endif  // SIMPLE_VOIP_WRAP__DIR_SCANNER_H
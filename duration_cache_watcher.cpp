@@ -0,0 +1,414 @@
+/*
+
+Simple VOIP Wrap. Duration Cache Watcher.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+// $Revision: 13981 $ $Date:: 2020-10-20 #$ $Author: serge $
+
+#include "duration_cache_watcher.h"     // self
+
+#include <sys/inotify.h>                // inotify_init1
+#include <sys/eventfd.h>                // eventfd
+#include <poll.h>                       // poll
+#include <unistd.h>                     // read, close, access
+#include <cerrno>                       // errno
+#include <exception>                    // std::exception
+
+#include "utils/mutex_helper.h"         // MUTEX_SCOPE_LOCK
+
+#include "dir_scanner.h"                // scan_subdirectories
+
+namespace simple_voip_wrap {
+
+static const uint32_t WATCH_MASK =
+        IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+static std::string strip_slash( const std::string & dir )
+{
+    auto res = dir;
+
+    while( res.size() > 1 && res.back() == '/' )
+        res.pop_back();
+
+    return res;
+}
+
+static std::string join( const std::string & dir, const std::string & name )
+{
+    return ( dir == "/" ) ? dir + name : dir + "/" + name;
+}
+
+DurationCacheWatcher::DurationCacheWatcher():
+    cache_( nullptr ),
+    batch_interval_( 0 ),
+    must_refresh_( false ),
+    inotify_fd_( -1 ),
+    stop_fd_( -1 ),
+    stats_( { 0, 0, 0, 0, 0, 0 } )
+{
+}
+
+DurationCacheWatcher::~DurationCacheWatcher()
+{
+    shutdown();
+}
+
+bool DurationCacheWatcher::init(
+        CachingDurationGetter               * cache,
+        const std::vector<std::string>      & dirs,
+        std::chrono::milliseconds           batch_interval,
+        bool                                must_refresh,
+        std::string                         * error_msg )
+{
+    if( cache == nullptr )
+    {
+        * error_msg = "cache is null";
+        return false;
+    }
+
+    if( dirs.empty() )
+    {
+        * error_msg = "no directories to watch";
+        return false;
+    }
+
+    if( batch_interval.count() < 0 )
+    {
+        * error_msg = "batch_interval is negative";
+        return false;
+    }
+
+    if( thread_.joinable() )
+    {
+        * error_msg = "already initialized";
+        return false;
+    }
+
+    inotify_fd_ = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+
+    if( inotify_fd_ == -1 )
+    {
+        * error_msg = "cannot initialize inotify, errno " + std::to_string( errno );
+        return false;
+    }
+
+    stop_fd_    = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+
+    if( stop_fd_ == -1 )
+    {
+        * error_msg = "cannot create eventfd, errno " + std::to_string( errno );
+        close_fds();
+        return false;
+    }
+
+    for( auto & d : dirs )
+    {
+        if( add_watches( strip_slash( d ), error_msg ) == false )
+        {
+            close_fds();
+            return false;
+        }
+    }
+
+    cache_          = cache;
+    batch_interval_ = batch_interval;
+    must_refresh_   = must_refresh;
+
+    thread_         = std::thread( & DurationCacheWatcher::thread_func, this );
+
+    return true;
+}
+
+void DurationCacheWatcher::shutdown()
+{
+    if( thread_.joinable() )
+    {
+        uint64_t v = 1;
+
+        auto res = write( stop_fd_, & v, sizeof( v ) );
+
+        (void)res;
+
+        thread_.join();
+    }
+
+    close_fds();
+}
+
+DurationCacheWatcher::Stats DurationCacheWatcher::get_stats() const
+{
+    MUTEX_SCOPE_LOCK( mutex_ );
+
+    return stats_;
+}
+
+bool DurationCacheWatcher::add_watches( const std::string & dir, std::string * error_msg )
+{
+    std::vector<std::string> dirs;
+
+    if( scan_subdirectories( & dirs, dir, error_msg ) == false )
+        return false;
+
+    for( auto & d : dirs )
+    {
+        auto wd = inotify_add_watch( inotify_fd_, d.c_str(), WATCH_MASK );
+
+        if( wd == -1 )
+        {
+            * error_msg = "cannot watch " + d + ", errno " + std::to_string( errno );
+            return false;
+        }
+
+        // the same wd is returned for a directory which is already watched, e.g. moved inside the tree
+        map_wd_to_dir_[ wd ] = d;
+    }
+
+    MUTEX_SCOPE_LOCK( mutex_ );
+
+    stats_.watches  = map_wd_to_dir_.size();
+
+    return true;
+}
+
+void DurationCacheWatcher::remove_watches( const std::string & dir )
+{
+    auto prefix = join( dir, "" );
+
+    for( auto it = map_wd_to_dir_.begin(); it != map_wd_to_dir_.end(); )
+    {
+        if( it->second == dir || it->second.compare( 0, prefix.size(), prefix ) == 0 )
+        {
+            inotify_rm_watch( inotify_fd_, it->first );
+
+            it = map_wd_to_dir_.erase( it );
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    MUTEX_SCOPE_LOCK( mutex_ );
+
+    stats_.watches  = map_wd_to_dir_.size();
+}
+
+void DurationCacheWatcher::thread_func()
+{
+    Batch batch;
+
+    batch.is_overflow   = false;
+
+    std::chrono::steady_clock::time_point deadline;
+
+    while( true )
+    {
+        bool is_empty = batch.files.empty() && batch.dirs.empty() && batch.is_overflow == false;
+
+        int timeout = -1;
+
+        if( is_empty == false )
+        {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>( deadline - std::chrono::steady_clock::now() ).count();
+
+            timeout = ( left > 0 ) ? static_cast<int>( left ) : 0;
+        }
+
+        pollfd fds[2] = { { stop_fd_, POLLIN, 0 }, { inotify_fd_, POLLIN, 0 } };
+
+        auto res = poll( fds, 2, timeout );
+
+        if( res == -1 && errno != EINTR )
+            return;
+
+        if( fds[0].revents & POLLIN )
+            return;
+
+        if( res > 0 && ( fds[1].revents & POLLIN ) )
+        {
+            read_events( & batch );
+
+            // the batch starts with its first event
+            if( is_empty )
+                deadline = std::chrono::steady_clock::now() + batch_interval_;
+        }
+
+        is_empty = batch.files.empty() && batch.dirs.empty() && batch.is_overflow == false;
+
+        if( is_empty == false && std::chrono::steady_clock::now() >= deadline )
+            apply( & batch );
+    }
+}
+
+void DurationCacheWatcher::read_events( Batch * batch )
+{
+    alignas( inotify_event ) char buf[ 16 * 1024 ];
+
+    uint64_t num_events = 0;
+
+    while( true )
+    {
+        auto len = read( inotify_fd_, buf, sizeof( buf ) );
+
+        if( len <= 0 )
+            break;
+
+        for( auto * p = buf; p < buf + len; )
+        {
+            auto * e = reinterpret_cast<const inotify_event *>( p );
+
+            p += sizeof( inotify_event ) + e->len;
+
+            ++num_events;
+
+            if( e->mask & IN_Q_OVERFLOW )
+            {
+                batch->is_overflow  = true;
+                continue;
+            }
+
+            auto it = map_wd_to_dir_.find( e->wd );
+
+            // IN_IGNORED comes after the watch is removed, explicitly or because the directory is gone
+            if( e->mask & IN_IGNORED )
+            {
+                if( it != map_wd_to_dir_.end() )
+                {
+                    map_wd_to_dir_.erase( it );
+
+                    MUTEX_SCOPE_LOCK( mutex_ );
+
+                    stats_.watches  = map_wd_to_dir_.size();
+                }
+                continue;
+            }
+
+            if( it == map_wd_to_dir_.end() )
+                continue;
+
+            if( e->mask & ( IN_DELETE_SELF | IN_MOVE_SELF ) )
+            {
+                batch->dirs.insert( join( it->second, "" ) );
+                continue;
+            }
+
+            auto path = join( it->second, ( e->len > 0 ) ? e->name : "" );
+
+            if( e->mask & IN_ISDIR )
+            {
+                // the cached files of a replaced directory are stale too
+                batch->dirs.insert( join( path, "" ) );
+
+                if( e->mask & IN_MOVED_FROM )
+                {
+                    remove_watches( path );
+                }
+                else if( e->mask & ( IN_CREATE | IN_MOVED_TO ) )
+                {
+                    // the directory may be gone already
+                    std::string error_msg;
+
+                    add_watches( path, & error_msg );
+                }
+
+                continue;
+            }
+
+            // a file is complete after close or rename, not after create
+            batch->files[ path ]    = ( e->mask & ( IN_CLOSE_WRITE | IN_MOVED_TO ) ) != 0;
+        }
+    }
+
+    MUTEX_SCOPE_LOCK( mutex_ );
+
+    stats_.events   += num_events;
+}
+
+void DurationCacheWatcher::apply( Batch * batch )
+{
+    uint64_t num_invalidations  = 0;
+    uint64_t num_refreshes      = 0;
+
+    if( batch->is_overflow )
+    {
+        // events are lost, nothing in the cache can be trusted
+        cache_->invalidate_all();
+    }
+    else
+    {
+        for( auto & d : batch->dirs )
+            num_invalidations += cache_->invalidate_prefix( d );
+
+        for( auto & f : batch->files )
+        {
+            if( cache_->invalidate( f.first ) == false )
+                continue;
+
+            ++num_invalidations;
+
+            if( must_refresh_ == false || f.second == false || access( f.first.c_str(), R_OK ) != 0 )
+                continue;
+
+            try
+            {
+                cache_->get_duration( f.first );
+
+                ++num_refreshes;
+            }
+            catch( std::exception & )
+            {
+            }
+        }
+    }
+
+    {
+        MUTEX_SCOPE_LOCK( mutex_ );
+
+        ++stats_.batches;
+        stats_.invalidations    += num_invalidations;
+        stats_.refreshes        += num_refreshes;
+
+        if( batch->is_overflow )
+            ++stats_.overflows;
+    }
+
+    batch->files.clear();
+    batch->dirs.clear();
+    batch->is_overflow  = false;
+}
+
+void DurationCacheWatcher::close_fds()
+{
+    if( inotify_fd_ != -1 )
+    {
+        close( inotify_fd_ );
+        inotify_fd_ = -1;
+    }
+
+    if( stop_fd_ != -1 )
+    {
+        close( stop_fd_ );
+        stop_fd_    = -1;
+    }
+
+    map_wd_to_dir_.clear();
+}
+
+} // namespace simple_voip_wrap
@@ -0,0 +1,119 @@
+/*
+
+Simple VOIP Wrap. Duration Cache Watcher.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+// $Revision: 13981 $ $Date:: 2020-10-20 #$ $Author: serge $
+
+#ifndef SIMPLE_VOIP_WRAP__DURATION_CACHE_WATCHER_H
+#define SIMPLE_VOIP_WRAP__DURATION_CACHE_WATCHER_H
+
+#include <mutex>                            // std::mutex
+#include <thread>                           // std::thread
+#include <chrono>                           // std::chrono
+#include <string>                           // std::string
+#include <vector>                           // std::vector
+#include <unordered_map>                    // std::unordered_map
+#include <unordered_set>                    // std::unordered_set
+#include <cstdint>                          // uint32_t
+
+#include "caching_duration_getter.h"        // CachingDurationGetter
+
+namespace simple_voip_wrap {
+
+/**
+ * @brief Watches directory trees with inotify and invalidates the changed files in a CachingDurationGetter.
+ *
+ * Allows to run the cache without validation, so that hits don't do any syscalls.
+ * Events are collected for batch_interval after the first one, then each changed file is invalidated once.
+ * If must_refresh is set, the files which were cached are probed again from the watcher thread.
+ * The cache must be looked up with the paths in the same form as the watched directories,
+ * e.g. "prompts/hello.wav" for "prompts".
+ */
+class DurationCacheWatcher
+{
+public:
+
+    struct Stats
+    {
+        uint64_t    events;
+        uint64_t    batches;
+        uint64_t    invalidations;      // cached files removed
+        uint64_t    refreshes;
+        uint64_t    overflows;          // event queue overflowed, the whole cache was dropped
+        uint32_t    watches;
+    };
+
+public:
+    DurationCacheWatcher();
+    ~DurationCacheWatcher();
+
+    bool init(
+            CachingDurationGetter               * cache,
+            const std::vector<std::string>      & dirs,
+            std::chrono::milliseconds           batch_interval,
+            bool                                must_refresh,
+            std::string                         * error_msg );
+
+    void shutdown();
+
+    Stats get_stats() const;
+
+private:
+
+    struct Batch
+    {
+        std::unordered_map<std::string,bool>    files;      // value - file may be refreshed
+        std::unordered_set<std::string>         dirs;       // prefixes, with trailing /
+        bool                                    is_overflow;
+    };
+
+private:
+
+    bool add_watches( const std::string & dir, std::string * error_msg );
+    void remove_watches( const std::string & dir );
+
+    void thread_func();
+
+    void read_events( Batch * batch );
+    void apply( Batch * batch );
+
+    void close_fds();
+
+private:
+    mutable std::mutex          mutex_;
+
+    CachingDurationGetter       * cache_;
+    std::chrono::milliseconds   batch_interval_;
+    bool                        must_refresh_;
+
+    int                         inotify_fd_;
+    int                         stop_fd_;           // eventfd to wake up the thread on shutdown
+
+    std::unordered_map<int,std::string>     map_wd_to_dir_;     // used by the thread only after init
+
+    Stats                       stats_;
+
+    std::thread                 thread_;
+};
+
+} // namespace simple_voip_wrap
+
+#endif  // SIMPLE_VOIP_WRAP__DURATION_CACHE_WATCHER_H
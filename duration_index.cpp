@@ -0,0 +1,164 @@
+/*
+
+Simple VOIP Wrap. Prebuilt Duration Index.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13979 $ $Date:: 2020-10-18 #$ $Author: serge $
+
+#include "duration_index.h"             // self
+
+#include <fstream>                      // std::ofstream
+#include <cstring>                      // memcpy
+#include <cstdio>                       // rename
+
+namespace simple_voip_wrap {
+
+namespace duration_index {
+
+uint64_t get_hash( const char * s, size_t size )
+{
+    uint64_t res = 14695981039346656037ull;
+
+    for( size_t i = 0; i < size; ++i )
+    {
+        res ^= static_cast<uint8_t>( s[i] );
+        res *= 1099511628211ull;
+    }
+
+    return res;
+}
+
+size_t get_entries_offset( uint32_t num_buckets )
+{
+    auto res = sizeof( Header ) + num_buckets * sizeof( uint32_t );
+
+    return ( res + 7 ) & ~static_cast<size_t>( 7 );
+}
+
+size_t get_names_offset( uint32_t num_buckets, uint32_t num_entries )
+{
+    return get_entries_offset( num_buckets ) + num_entries * sizeof( Entry );
+}
+
+bool write( const std::string & filename, const std::vector<std::pair<std::string, double>> & durations, std::string * error_msg )
+{
+    if( durations.size() > 0x3FFFFFFF )
+    {
+        * error_msg = "too many entries";
+        return false;
+    }
+
+    auto num_entries = static_cast<uint32_t>( durations.size() );
+
+    uint32_t num_buckets = 2;
+
+    while( num_buckets < num_entries * 2 )
+        num_buckets *= 2;
+
+    Header h;
+
+    memcpy( h.magic, MAGIC, sizeof( h.magic ) );
+
+    h.version       = VERSION;
+    h.num_entries   = num_entries;
+    h.num_buckets   = num_buckets;
+    h.reserved      = 0;
+    h.names_size    = 0;
+
+    std::vector<uint32_t>   buckets( num_buckets, 0 );
+    std::vector<Entry>      entries( num_entries );
+
+    auto mask = num_buckets - 1;
+
+    for( uint32_t i = 0; i < num_entries; ++i )
+    {
+        auto & name = durations[i].first;
+
+        auto & e = entries[i];
+
+        e.hash          = get_hash( name.data(), name.size() );
+        e.name_offset   = h.names_size;
+        e.name_size     = static_cast<uint32_t>( name.size() );
+        e.reserved      = 0;
+        e.duration      = durations[i].second;
+
+        h.names_size    += name.size();
+
+        auto b = static_cast<uint32_t>( e.hash ) & mask;
+
+        while( buckets[b] != 0 )
+        {
+            auto & other = entries[ buckets[b] - 1 ];
+
+            if( other.hash == e.hash && durations[ buckets[b] - 1 ].first == name )
+            {
+                * error_msg = "duplicate file name: " + name;
+                return false;
+            }
+
+            b = ( b + 1 ) & mask;
+        }
+
+        buckets[b]  = i + 1;
+    }
+
+    auto tmp_filename = filename + ".tmp";
+
+    {
+        std::ofstream os( tmp_filename, std::ios::binary | std::ios::trunc );
+
+        if( os.fail() )
+        {
+            * error_msg = "cannot open " + tmp_filename;
+            return false;
+        }
+
+        os.write( reinterpret_cast<const char*>( & h ), sizeof( h ) );
+        os.write( reinterpret_cast<const char*>( buckets.data() ), buckets.size() * sizeof( uint32_t ) );
+
+        static const char padding[8] = { 0 };
+
+        os.write( padding, get_entries_offset( num_buckets ) - sizeof( h ) - buckets.size() * sizeof( uint32_t ) );
+
+        os.write( reinterpret_cast<const char*>( entries.data() ), entries.size() * sizeof( Entry ) );
+
+        for( auto & d : durations )
+            os.write( d.first.data(), d.first.size() );
+
+        os.flush();
+
+        if( os.fail() )
+        {
+            * error_msg = "cannot write " + tmp_filename;
+            return false;
+        }
+    }
+
+    if( rename( tmp_filename.c_str(), filename.c_str() ) != 0 )
+    {
+        * error_msg = "cannot rename " + tmp_filename + " to " + filename;
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace duration_index
+
+} // namespace simple_voip_wrap
@@ -0,0 +1,84 @@
+/*
+
+Simple VOIP Wrap. Prebuilt Duration Index.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13979 $ $Date:: 2020-10-18 #$ $Author: serge $
+
+#ifndef SIMPLE_VOIP_WRAP__DURATION_INDEX_H
+#define SIMPLE_VOIP_WRAP__DURATION_INDEX_H
+
+#include <string>                           // std::string
+#include <vector>                           // std::vector
+#include <utility>                          // std::pair
+#include <cstdint>                          // uint32_t
+#include <cstddef>                          // size_t
+
+namespace simple_voip_wrap {
+
+/**
+ * @brief File format of the prebuilt index of play durations.
+ *
+ * The file is used as is after mmap, there is nothing to parse:
+ *
+ *   Header
+ *   uint32_t buckets[ num_buckets ]    - index of the entry + 1, 0 - empty, linear probing
+ *   Entry    entries[ num_entries ]    - aligned to 8 bytes
+ *   char     names[ names_size ]       - file names, not null-terminated
+ *
+ * Integers are stored in the byte order of the host which has built the index.
+ */
+namespace duration_index {
+
+const char     MAGIC[8]     = "SVWDIDX";
+const uint32_t VERSION      = 1;
+
+struct Header
+{
+    char        magic[8];           // "SVWDIDX" and a null
+    uint32_t    version;
+    uint32_t    num_entries;
+    uint32_t    num_buckets;        // power of 2, at least twice the number of entries
+    uint32_t    reserved;
+    uint64_t    names_size;
+};
+
+struct Entry
+{
+    uint64_t    hash;
+    uint64_t    name_offset;        // in the names area
+    uint32_t    name_size;
+    uint32_t    reserved;
+    double      duration;           // seconds
+};
+
+// FNV-1a
+uint64_t get_hash( const char * s, size_t size );
+
+size_t get_entries_offset( uint32_t num_buckets );
+size_t get_names_offset( uint32_t num_buckets, uint32_t num_entries );
+
+// writes into a temporary file and renames it, so that the processes which have mapped the old index are not affected
+bool write( const std::string & filename, const std::vector<std::pair<std::string, double>> & durations, std::string * error_msg );
+
+} // namespace duration_index
+
+} // namespace simple_voip_wrap
+
+#endif  // SIMPLE_VOIP_WRAP__DURATION_INDEX_H
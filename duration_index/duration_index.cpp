@@ -0,0 +1,212 @@
+/*
+
+Duration index builder.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13979 $ $Date:: 2020-10-18 #$ $Author: serge $
+
+#include <iostream>         // cout
+#include <string>           // std::string
+#include <vector>           // std::vector
+#include <chrono>           // std::chrono
+#include <exception>        // std::exception
+#include <cstdlib>          // EXIT_FAILURE
+#include <cmath>            // std::fabs
+
+#include "wav_tools/get_wav_duration.h"             // get_wav_duration()
+
+#include "simple_voip_wrap/dir_scanner.h"           // scan_directory
+#include "simple_voip_wrap/duration_index.h"        // duration_index::write
+#include "simple_voip_wrap/header_duration_getter.h"    // HeaderDurationGetter
+
+namespace duration_index_tool {
+
+class SndfileDurationGetter: virtual public simple_voip_wrap::IGetDuration
+{
+public:
+    double get_duration( const std::string & filename ) override
+    {
+        return wav_tools::get_wav_duration( filename );
+    }
+};
+
+// allowed difference between the header probe and sndfile, seconds
+const double MAX_DIFF   = 0.0005;
+
+void print_usage()
+{
+    std::cout << "usage: duration_index [-e <extension>] [-p | -v] <index_file> <prompt_dir> [<prompt_dir> ...]" << std::endl;
+    std::cout << "  scans the directories and writes the durations of the files into the index," << std::endl;
+    std::cout << "  file names are stored as <prompt_dir>/<relative path>, so use the same directory names as the application" << std::endl;
+    std::cout << "  -e <extension> - extension of the files, default .wav" << std::endl;
+    std::cout << "  -p             - probe the file headers, fall back to sndfile for unsupported files" << std::endl;
+    std::cout << "  -v             - probe with sndfile and verify the header probe against it" << std::endl;
+}
+
+int run( int argc, char ** argv )
+{
+    std::string extension = ".wav";
+
+    bool must_probe     = false;
+    bool must_verify    = false;
+
+    std::vector<std::string> args;
+
+    for( int i = 1; i < argc; ++i )
+    {
+        std::string a( argv[i] );
+
+        if( a == "-e" && i + 1 < argc )
+            extension = argv[ ++i ];
+        else if( a == "-p" )
+            must_probe  = true;
+        else if( a == "-v" )
+            must_verify = true;
+        else
+            args.push_back( a );
+    }
+
+    if( args.size() < 2 || ( must_probe && must_verify ) )
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    auto & index_file = args[0];
+
+    std::vector<std::string> files;
+
+    std::string error_msg;
+
+    for( size_t i = 1; i < args.size(); ++i )
+    {
+        if( simple_voip_wrap::scan_directory( & files, args[i], extension, & error_msg ) == false )
+        {
+            std::cout << "ERROR: " << error_msg << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::cout << "found " << files.size() << " files" << std::endl;
+
+    SndfileDurationGetter                   sdg;
+    simple_voip_wrap::HeaderDurationGetter  hdg;
+
+    if( hdg.init( & sdg, & error_msg ) == false )
+    {
+        std::cout << "ERROR: " << error_msg << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    simple_voip_wrap::IGetDuration & gd = must_probe ? static_cast<simple_voip_wrap::IGetDuration&>( hdg ) : sdg;
+
+    uint32_t num_mismatches     = 0;
+    uint32_t num_unsupported    = 0;
+    double   probe_sec          = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::pair<std::string, double>> durations;
+
+    durations.reserve( files.size() );
+
+    uint32_t num_errors = 0;
+
+    for( auto & f : files )
+    {
+        try
+        {
+            auto d = gd.get_duration( f );
+
+            durations.push_back( std::make_pair( f, d ) );
+
+            if( must_verify )
+            {
+                double      p;
+                std::string probe_error;
+
+                auto probe_start = std::chrono::steady_clock::now();
+
+                auto b = simple_voip_wrap::HeaderDurationGetter::probe( f, & p, & probe_error );
+
+                probe_sec += std::chrono::duration<double>( std::chrono::steady_clock::now() - probe_start ).count();
+
+                if( b == false )
+                {
+                    std::cout << "UNSUPPORTED: " << f << ": " << probe_error << std::endl;
+
+                    ++num_unsupported;
+                }
+                else if( std::fabs( p - d ) > MAX_DIFF )
+                {
+                    std::cout << "MISMATCH: " << f << ": probe " << p << ", sndfile " << d << std::endl;
+
+                    ++num_mismatches;
+                }
+            }
+        }
+        catch( std::exception & e )
+        {
+            std::cout << "WARNING: skipped " << f << ": " << e.what() << std::endl;
+
+            ++num_errors;
+        }
+
+        auto n = durations.size() + num_errors;
+
+        if( n % 10000 == 0 )
+            std::cout << "probed " << n << " of " << files.size() << std::endl;
+    }
+
+    auto sec = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+    if( simple_voip_wrap::duration_index::write( index_file, durations, & error_msg ) == false )
+    {
+        std::cout << "ERROR: " << error_msg << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "wrote " << durations.size() << " entries to " << index_file << ", skipped " << num_errors
+            << ", probed in " << sec << " sec" << std::endl;
+
+    if( must_probe )
+    {
+        auto stats = hdg.get_stats();
+
+        std::cout << "header probes " << stats.probes << ", sndfile fallbacks " << stats.fallbacks << std::endl;
+    }
+
+    if( must_verify )
+    {
+        std::cout << "verified " << durations.size() << " files: " << num_mismatches << " mismatches, "
+                << num_unsupported << " unsupported, header probe took " << probe_sec << " sec" << std::endl;
+
+        if( num_mismatches > 0 )
+            return EXIT_FAILURE;
+    }
+
+    return 0;
+}
+
+} // namespace duration_index_tool
+
+int main( int argc, char ** argv )
+{
+    return duration_index_tool::run( argc, argv );
+}
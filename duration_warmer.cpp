@@ -0,0 +1,187 @@
+/*
+
+Simple VOIP Wrap. Duration Warmer.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13980 $ $Date:: 2020-10-19 #$ $Author: serge $
+
+#include "duration_warmer.h"            // self
+
+#include <fstream>                      // std::ifstream
+#include <atomic>                       // std::atomic
+#include <mutex>                        // std::mutex
+#include <condition_variable>           // std::condition_variable
+#include <exception>                    // std::exception
+
+#include "utils/mutex_helper.h"         // MUTEX_SCOPE_LOCK
+
+#include "worker_pool.h"                // WorkerPool
+#include "dir_scanner.h"                // scan_directory
+
+namespace simple_voip_wrap {
+
+DurationWarmer::DurationWarmer():
+    gd_( nullptr ),
+    num_threads_( 0 )
+{
+}
+
+bool DurationWarmer::init(
+        IGetDuration                        * gd,
+        uint32_t                            num_threads,
+        std::string                         * error_msg )
+{
+    if( gd == nullptr )
+    {
+        * error_msg = "gd is null";
+        return false;
+    }
+
+    if( num_threads == 0 )
+    {
+        * error_msg = "num_threads is 0";
+        return false;
+    }
+
+    gd_             = gd;
+    num_threads_    = num_threads;
+
+    return true;
+}
+
+bool DurationWarmer::add_directory( const std::string & dir, const std::string & extension, std::string * error_msg )
+{
+    return scan_directory( & files_, dir, extension, error_msg );
+}
+
+bool DurationWarmer::add_manifest( const std::string & filename, std::string * error_msg )
+{
+    std::ifstream is( filename );
+
+    if( is.fail() )
+    {
+        * error_msg = "cannot open manifest " + filename;
+        return false;
+    }
+
+    std::string line;
+
+    while( std::getline( is, line ) )
+    {
+        if( line.empty() == false && line.back() == '\r' )
+            line.pop_back();
+
+        if( line.empty() || line[0] == '#' )
+            continue;
+
+        files_.push_back( line );
+    }
+
+    return true;
+}
+
+void DurationWarmer::add_file( const std::string & filename )
+{
+    files_.push_back( filename );
+}
+
+bool DurationWarmer::run( Progress * res, std::chrono::milliseconds interval, const ProgressFunc & progress, std::string * error_msg )
+{
+    if( gd_ == nullptr )
+    {
+        * error_msg = "not initialized";
+        return false;
+    }
+
+    WorkerPool pool;
+
+    if( pool.init( num_threads_, error_msg ) == false )
+        return false;
+
+    std::atomic<uint32_t>   next( 0 );
+    std::atomic<uint32_t>   num_errors( 0 );
+
+    std::mutex              mutex;
+    std::condition_variable cond;
+    uint32_t                num_done = 0;
+
+    auto num_files = static_cast<uint32_t>( files_.size() );
+
+    // each thread takes the next file, so that slow files don't hold up a whole chunk
+    for( uint32_t t = 0; t < num_threads_; ++t )
+    {
+        pool.submit(
+                [&]()
+                {
+                    uint32_t i;
+
+                    while( ( i = next.fetch_add( 1 ) ) < num_files )
+                    {
+                        try
+                        {
+                            gd_->get_duration( files_[i] );
+                        }
+                        catch( std::exception & )
+                        {
+                            num_errors.fetch_add( 1 );
+                        }
+
+                        MUTEX_SCOPE_LOCK( mutex );
+
+                        if( ++num_done == num_files )
+                            cond.notify_one();
+                    }
+                } );
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    while( true )
+    {
+        uint32_t done;
+
+        {
+            std::unique_lock<std::mutex> lock( mutex );
+
+            cond.wait_for( lock, interval, [&]() { return num_done == num_files; } );
+
+            done = num_done;
+        }
+
+        auto elapsed = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+        res->num_files      = num_files;
+        res->num_done       = done;
+        res->num_errors     = num_errors.load();
+        res->elapsed        = elapsed;
+        res->files_per_sec  = ( elapsed > 0 ) ? done / elapsed : 0;
+
+        if( progress )
+            progress( * res );
+
+        if( done == num_files )
+            break;
+    }
+
+    pool.shutdown();
+
+    return true;
+}
+
+} // namespace simple_voip_wrap
@@ -0,0 +1,87 @@
+/*
+
+Simple VOIP Wrap. Duration Warmer.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13980 $ $Date:: 2020-10-19 #$ $Author: serge $
+
+#ifndef SIMPLE_VOIP_WRAP__DURATION_WARMER_H
+#define SIMPLE_VOIP_WRAP__DURATION_WARMER_H
+
+#include <vector>                           // std::vector
+#include <string>                           // std::string
+#include <functional>                       // std::function
+#include <chrono>                           // std::chrono
+#include <cstdint>                          // uint32_t
+
+#include "i_get_duration.h"                 // IGetDuration
+
+namespace simple_voip_wrap {
+
+/**
+ * @brief Probes the durations of a set of files in parallel, so that a caching IGetDuration is warm before traffic arrives.
+ *
+ * Files are collected from directories and manifests, run() calls IGetDuration::get_duration() for each of them
+ * on a temporary WorkerPool. Not thread-safe.
+ */
+class DurationWarmer
+{
+public:
+
+    struct Progress
+    {
+        uint32_t    num_files;
+        uint32_t    num_done;
+        uint32_t    num_errors;         // get_duration has thrown an exception
+        double      elapsed;            // seconds
+        double      files_per_sec;
+    };
+
+    typedef std::function<void( const Progress & )>  ProgressFunc;
+
+public:
+    DurationWarmer();
+
+    bool init(
+            IGetDuration                        * gd,
+            uint32_t                            num_threads,
+            std::string                         * error_msg );
+
+    // files of the directory tree with the extension, see scan_directory()
+    bool add_directory( const std::string & dir, const std::string & extension, std::string * error_msg );
+
+    // text file with one file name per line, empty lines and lines starting with # are skipped
+    bool add_manifest( const std::string & filename, std::string * error_msg );
+
+    void add_file( const std::string & filename );
+
+    // blocks until all files are probed, progress is called from the calling thread every interval and at the end
+    bool run( Progress * res, std::chrono::milliseconds interval, const ProgressFunc & progress, std::string * error_msg );
+
+private:
+
+    IGetDuration                * gd_;
+    uint32_t                    num_threads_;
+
+    std::vector<std::string>    files_;
+};
+
+} // namespace simple_voip_wrap
+
+#endif  // SIMPLE_VOIP_WRAP__DURATION_WARMER_H
@@ -19,7 +19,7 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 */
 
-// $Revision: 13958 $ $Date:: 2020-10-05 #$ $Author: serge $
+// $Revision: 13981 $ $Date:: 2020-10-20 #$ $Author: serge $
 
 #include <iostream>         // cout
 #include <typeinfo>
@@ -43,6 +43,8 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include "wrap.h"                               // simple_voip_wrap::Wrap
 #include "object_factory.h"                     // simple_voip::wrap::create_PlayFileRequest
 #include "i_get_duration.h"                     // IGetDuration
+#include "caching_duration_getter.h"            // CachingDurationGetter
+#include "object_pool.h"                        // ObjectPool
 #include "str_helper.h"                         // to_string()
 
 struct DurationGetter: virtual public simple_voip_wrap::IGetDuration
@@ -84,7 +86,9 @@ public:
         std::cout << "call <party>" << std::endl;
         std::cout << "drop <call_id>" << std::endl;
         std::cout << "play <call_id> <file>" << std::endl;
+        std::cout << "playlist <call_id> <file1> [<file2> ...]" << std::endl;
         std::cout << "rec <call_id> <file> <duration>" << std::endl;
+        std::cout << "stats" << std::endl;
 
         std::string input;
 
@@ -145,6 +149,21 @@ private:
 
                 voips_->consume( simple_voip::wrap::create_PlayFileRequest( req_id, call_id, filename ) );
             }
+            else if( cmd == "playlist" )
+            {
+                auto req_id = req_id_gen_->get_next_request_id();
+
+                uint32_t call_id;
+                stream >> call_id;
+
+                std::vector<std::string> filenames;
+                std::string filename;
+
+                while( stream >> filename )
+                    filenames.push_back( filename );
+
+                voips_->consume( simple_voip::wrap::create_PlayListRequest( req_id, call_id, filenames ) );
+            }
             else if( cmd == "rec" )
             {
                 auto req_id = req_id_gen_->get_next_request_id();
@@ -164,6 +183,15 @@ private:
                 }
 
             }
+            else if( cmd == "stats" )
+            {
+                for( auto & s : simple_voip_wrap::ObjectPool::get_all_stats() )
+                {
+                    std::cout << "pool " << s.name << ": object size " << s.object_size
+                            << ", allocations " << s.allocations << ", releases " << s.releases
+                            << ", cache misses " << s.cache_misses << ", capacity " << s.capacity << std::endl;
+                }
+            }
             else
                 std::cout << "ERROR: unknown command '" << cmd << "'" << std::endl;
         }
@@ -188,6 +216,7 @@ int main( int argc, char **argv )
     simple_voip_wrap::Wrap          wrap;
     utils::RequestIdGen             req_id_gen;
     DurationGetter                  dg;
+    simple_voip_wrap::CachingDurationGetter cdg;
     Callback test;
 
     simple_voip_dummy::Config config;
@@ -226,7 +255,16 @@ int main( int argc, char **argv )
     }
 
     {
-        bool b = wrap.init( log_id_wrap, & dialer, & test, & sched, & req_id_gen, & dg, & error_msg );
+        bool b = cdg.init( & dg, 1000, true, & error_msg );
+        if( !b )
+        {
+            std::cout << "cannot initialize CachingDurationGetter: " << error_msg << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    {
+        bool b = wrap.init( log_id_wrap, & dialer, & test, & sched, & req_id_gen, & cdg, & error_msg );
         if( !b )
         {
             std::cout << "cannot initialize Wrap: " << error_msg << std::endl;
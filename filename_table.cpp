@@ -0,0 +1,158 @@
+/*
+
+Simple VOIP Wrap. Filename Table.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13978 $ $Date:: 2020-10-17 #$ $Author: serge $
+
+#include "filename_table.h"             // self
+
+#include <algorithm>                    // std::min
+
+#include "utils/mutex_helper.h"         // MUTEX_SCOPE_LOCK
+#include "utils/utils_assert.h"         // ASSERT
+
+namespace simple_voip_wrap {
+
+FilenameTable::FilenameTable():
+    max_size_( 0 ),
+    size_( 0 ),
+    num_chunks_( 0 )
+{
+}
+
+FilenameTable::~FilenameTable()
+{
+    for( uint32_t i = 0; i < num_chunks_; ++i )
+        delete [] chunks_[i].load( std::memory_order_relaxed );
+}
+
+bool FilenameTable::init( uint32_t max_size, std::string * error_msg )
+{
+    if( max_size == 0 )
+    {
+        * error_msg = "max_size is 0";
+        return false;
+    }
+
+    if( max_size_ != 0 )
+    {
+        * error_msg = "already initialized";
+        return false;
+    }
+
+    max_size_   = max_size;
+    num_chunks_ = ( max_size + CHUNK_SIZE - 1 ) / CHUNK_SIZE;
+
+    chunks_.reset( new std::atomic<Entry*>[ num_chunks_ ] );
+
+    for( uint32_t i = 0; i < num_chunks_; ++i )
+        chunks_[i].store( nullptr, std::memory_order_relaxed );
+
+    for( auto & s : stripes_ )
+        s.map_key_to_id.reserve( max_size / NUM_STRIPES + 1 );
+
+    return true;
+}
+
+filename_id_t FilenameTable::intern( const std::string & filename )
+{
+    if( max_size_ == 0 )
+        return 0;
+
+    auto hash = std::hash<std::string>()( filename );
+
+    // the low bits select the bucket of the stripe's map, so the stripe is taken from the high bits
+    auto & stripe = stripes_[ ( hash >> ( sizeof( size_t ) * 8 - 4 ) ) % NUM_STRIPES ];
+
+    MUTEX_SCOPE_LOCK( stripe.mutex );
+
+    auto it = stripe.map_key_to_id.find( Key { & filename, hash } );
+
+    if( it != stripe.map_key_to_id.end() )
+        return it->second;
+
+    auto id = add_entry( filename, hash );
+
+    if( id == 0 )
+        return 0;
+
+    stripe.map_key_to_id.insert( std::make_pair( Key { & get_entry( id ).filename, hash }, id ) );
+
+    return id;
+}
+
+const std::string & FilenameTable::get( filename_id_t id ) const
+{
+    return get_entry( id ).filename;
+}
+
+size_t FilenameTable::get_hash( filename_id_t id ) const
+{
+    return get_entry( id ).hash;
+}
+
+uint32_t FilenameTable::get_size() const
+{
+    // pairs with the release in add_entry(), an id below the size refers to a filled entry
+    return std::min( size_.load( std::memory_order_acquire ), max_size_ );
+}
+
+filename_id_t FilenameTable::add_entry( const std::string & filename, size_t hash )
+{
+    // new filenames are rare, so the entries are appended one at a time and published in order
+    MUTEX_SCOPE_LOCK( add_mutex_ );
+
+    auto index = size_.load( std::memory_order_relaxed );
+
+    if( index >= max_size_ )
+        return 0;
+
+    auto & chunk = chunks_[ index / CHUNK_SIZE ];
+
+    auto * entries = chunk.load( std::memory_order_relaxed );
+
+    if( entries == nullptr )
+    {
+        entries = new Entry[ CHUNK_SIZE ];
+
+        chunk.store( entries, std::memory_order_release );
+    }
+
+    auto & e = entries[ index % CHUNK_SIZE ];
+
+    e.filename  = filename;
+    e.hash      = hash;
+
+    size_.store( index + 1, std::memory_order_release );
+
+    return index + 1;
+}
+
+const FilenameTable::Entry & FilenameTable::get_entry( filename_id_t id ) const
+{
+    ASSERT( id > 0 && id <= max_size_ );
+
+    auto index = id - 1;
+
+    // the id has reached the caller after the entry was published, so the entry is visible
+    return chunks_[ index / CHUNK_SIZE ].load( std::memory_order_acquire )[ index % CHUNK_SIZE ];
+}
+
+} // namespace simple_voip_wrap
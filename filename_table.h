@@ -0,0 +1,135 @@
+/*
+
+Simple VOIP Wrap. Filename Table.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13978 $ $Date:: 2020-10-17 #$ $Author: serge $
+
+#ifndef SIMPLE_VOIP_WRAP__FILENAME_TABLE_H
+#define SIMPLE_VOIP_WRAP__FILENAME_TABLE_H
+
+#include <mutex>                            // std::mutex
+#include <atomic>                           // std::atomic
+#include <memory>                           // std::unique_ptr
+#include <unordered_map>                    // std::unordered_map
+#include <string>                           // std::string
+#include <cstdint>                          // uint32_t
+
+namespace simple_voip_wrap {
+
+// id of an interned filename, 0 - not interned
+typedef uint32_t    filename_id_t;
+
+/**
+ * @brief Interns filenames, so that a filename is stored and hashed only once and is passed around as a 4-byte id.
+ *
+ * Filenames are never removed, the table is meant for prompts, which are a bounded set, and is limited to max_size.
+ * intern() locks one of several stripes, get() is lock-free. Thread-safe.
+ */
+class FilenameTable
+{
+public:
+    FilenameTable();
+    ~FilenameTable();
+
+    bool init( uint32_t max_size, std::string * error_msg );
+
+    // returns 0 if the table is full
+    filename_id_t intern( const std::string & filename );
+
+    // id must be returned by intern(), the reference is valid for the lifetime of the table
+    const std::string & get( filename_id_t id ) const;
+
+    // std::hash<std::string> of the filename
+    size_t get_hash( filename_id_t id ) const;
+
+    uint32_t get_size() const;
+
+private:
+
+    FilenameTable( const FilenameTable & )              = delete;
+    FilenameTable & operator=( const FilenameTable & )  = delete;
+
+    enum
+    {
+        NUM_STRIPES = 16,
+        CHUNK_SIZE  = 1024,     // entries are allocated in chunks, so that they never move
+    };
+
+    struct Entry
+    {
+        std::string filename;
+        size_t      hash;
+    };
+
+    struct Key
+    {
+        const std::string   * filename;
+        size_t              hash;
+    };
+
+    struct HashKey
+    {
+        size_t operator()( const Key & k ) const
+        {
+            return k.hash;
+        }
+    };
+
+    struct EqualKey
+    {
+        bool operator()( const Key & l, const Key & r ) const
+        {
+            return l.hash == r.hash && * l.filename == * r.filename;
+        }
+    };
+
+    // key points to Entry::filename
+    typedef std::unordered_map<Key, filename_id_t, HashKey, EqualKey>   MapKeyToId;
+
+    struct Stripe
+    {
+        std::mutex          mutex;
+        MapKeyToId          map_key_to_id;
+    };
+
+private:
+
+    // returns 0 if the table is full
+    filename_id_t add_entry( const std::string & filename, size_t hash );
+
+    const Entry & get_entry( filename_id_t id ) const;
+
+private:
+
+    uint32_t                    max_size_;
+
+    std::atomic<uint32_t>       size_;          // number of filled entries, written under add_mutex_
+
+    std::mutex                  add_mutex_;     // serializes appending of the entries and allocation of the chunks
+
+    uint32_t                    num_chunks_;
+    std::unique_ptr<std::atomic<Entry*>[]>  chunks_;
+
+    Stripe                      stripes_[ NUM_STRIPES ];
+};
+
+} // namespace simple_voip_wrap
+
+#endif  // SIMPLE_VOIP_WRAP__FILENAME_TABLE_H
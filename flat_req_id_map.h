@@ -0,0 +1,234 @@
+/*
+
+Simple VOIP Wrap. Flat map with uint32_t keys.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13964 $ $Date:: 2020-10-09 #$ $Author: serge $
+
+#ifndef SIMPLE_VOIP_WRAP__FLAT_REQ_ID_MAP_H
+#define SIMPLE_VOIP_WRAP__FLAT_REQ_ID_MAP_H
+
+#include <vector>                           // std::vector
+#include <cstdint>                          // uint32_t
+#include <utility>                          // std::move
+
+namespace simple_voip_wrap {
+
+/**
+ * @brief Open addressing hash map with linear probing and a fixed capacity.
+ *
+ * All slots are allocated in init(), insert/find/erase don't allocate.
+ * The table is kept at most half full, erase uses backward shift, so there are no tombstones.
+ */
+template <class V>
+class FlatReqIdMap
+{
+public:
+
+    FlatReqIdMap():
+        max_size_( 0 ),
+        size_( 0 ),
+        mask_( 0 ),
+        shift_( 32 )
+    {
+    }
+
+    void init( uint32_t max_size )
+    {
+        uint32_t bits   = 1;
+
+        while( ( 1u << bits ) < max_size * 2 )
+            ++bits;
+
+        max_size_   = max_size;
+        size_       = 0;
+        mask_       = ( 1u << bits ) - 1;
+        shift_      = 32 - bits;
+
+        slots_.clear();
+        slots_.resize( mask_ + 1 );
+    }
+
+    // returns false if the key already exists or the map is full
+    bool insert( uint32_t key, const V & value )
+    {
+        if( size_ >= max_size_ )
+            return false;
+
+        auto i = get_pos( key );
+
+        while( slots_[i].is_used )
+        {
+            if( slots_[i].key == key )
+                return false;
+
+            i = ( i + 1 ) & mask_;
+        }
+
+        slots_[i].key       = key;
+        slots_[i].is_used   = true;
+        slots_[i].value     = value;
+
+        ++size_;
+
+        return true;
+    }
+
+    V * find( uint32_t key )
+    {
+        auto i = find_pos( key );
+
+        if( i > mask_ )
+            return nullptr;
+
+        return & slots_[i].value;
+    }
+
+    bool erase( uint32_t key )
+    {
+        auto i = find_pos( key );
+
+        if( i > mask_ )
+            return false;
+
+        erase_pos( i );
+
+        return true;
+    }
+
+    uint32_t size() const
+    {
+        return size_;
+    }
+
+    uint32_t max_size() const
+    {
+        return max_size_;
+    }
+
+    bool is_full() const
+    {
+        return size_ >= max_size_;
+    }
+
+    // number of slots, positions for get_at() are 0 .. capacity() - 1
+    uint32_t capacity() const
+    {
+        return slots_.size();
+    }
+
+    // returns nullptr if the slot is free, erase may move an entry to a lower position
+    V * get_at( uint32_t pos, uint32_t * key )
+    {
+        auto & s = slots_[ pos ];
+
+        if( s.is_used == false )
+            return nullptr;
+
+        * key = s.key;
+
+        return & s.value;
+    }
+
+private:
+
+    struct Slot
+    {
+        Slot():
+            key( 0 ),
+            is_used( false )
+        {
+        }
+
+        uint32_t    key;
+        bool        is_used;
+        V           value;
+    };
+
+private:
+
+    uint32_t get_pos( uint32_t key ) const
+    {
+        // Fibonacci hashing, req ids are mostly sequential
+        return ( key * 2654435769u ) >> shift_;
+    }
+
+    uint32_t find_pos( uint32_t key ) const
+    {
+        if( slots_.empty() )
+            return mask_ + 1;
+
+        auto i = get_pos( key );
+
+        while( slots_[i].is_used )
+        {
+            if( slots_[i].key == key )
+                return i;
+
+            i = ( i + 1 ) & mask_;
+        }
+
+        return mask_ + 1;
+    }
+
+    void erase_pos( uint32_t i )
+    {
+        // shift back the following entries of the probe sequence
+        auto j = i;
+
+        while( true )
+        {
+            j = ( j + 1 ) & mask_;
+
+            if( slots_[j].is_used == false )
+                break;
+
+            auto k = get_pos( slots_[j].key );
+
+            // move the entry only if its home position is not within (i, j]
+            bool is_between = ( i <= j ) ? ( i < k && k <= j ) : ( i < k || k <= j );
+
+            if( is_between )
+                continue;
+
+            slots_[i].key       = slots_[j].key;
+            slots_[i].value     = std::move( slots_[j].value );
+
+            i = j;
+        }
+
+        slots_[i].is_used   = false;
+        slots_[i].value     = V();
+
+        --size_;
+    }
+
+private:
+
+    uint32_t            max_size_;
+    uint32_t            size_;
+    uint32_t            mask_;
+    uint32_t            shift_;
+
+    std::vector<Slot>   slots_;
+};
+
+} // namespace simple_voip_wrap
+
+#endif  // SIMPLE_VOIP_WRAP__FLAT_REQ_ID_MAP_H
@@ -0,0 +1,534 @@
+/*
+
+Simple VOIP Wrap. Header Duration Getter.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13982 $ $Date:: 2020-10-21 #$ $Author: serge $
+
+#include "header_duration_getter.h"     // self
+
+#include <sys/stat.h>                   // fstat
+#include <fcntl.h>                      // open
+#include <unistd.h>                     // pread, close
+#include <cstring>                      // memcmp, memcpy
+#include <vector>                       // std::vector
+#include <algorithm>                    // std::min
+#include <stdexcept>                    // std::runtime_error
+
+namespace simple_voip_wrap {
+
+namespace {
+
+enum
+{
+    HEADER_SIZE     = 4096,                 // fmt, fact and data chunks of a typical WAV, STREAMINFO, first Ogg page
+    TAIL_SIZE       = 8192,                 // the last Ogg page of a prompt is usually much smaller
+    MAX_TAIL_SIZE   = 27 + 255 + 255 * 255, // maximal Ogg page
+    MAX_CHUNKS      = 64,                   // protects against garbage in the chunk sizes
+};
+
+enum
+{
+    WAVE_FORMAT_PCM         = 0x0001,
+    WAVE_FORMAT_IEEE_FLOAT  = 0x0003,
+    WAVE_FORMAT_ALAW        = 0x0006,
+    WAVE_FORMAT_MULAW       = 0x0007,
+    WAVE_FORMAT_EXTENSIBLE  = 0xFFFE,
+};
+
+inline uint16_t get_le16( const uint8_t * p )
+{
+    return p[0] | ( p[1] << 8 );
+}
+
+inline uint32_t get_le32( const uint8_t * p )
+{
+    return p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ( static_cast<uint32_t>( p[3] ) << 24 );
+}
+
+inline uint64_t get_le64( const uint8_t * p )
+{
+    return get_le32( p ) | ( static_cast<uint64_t>( get_le32( p + 4 ) ) << 32 );
+}
+
+inline uint32_t get_be32( const uint8_t * p )
+{
+    return ( static_cast<uint32_t>( p[0] ) << 24 ) | ( p[1] << 16 ) | ( p[2] << 8 ) | p[3];
+}
+
+/**
+ * @brief Open file with its first HEADER_SIZE bytes.
+ */
+class File
+{
+public:
+    File():
+        fd_( -1 ),
+        size_( 0 ),
+        header_size_( 0 )
+    {
+    }
+
+    ~File()
+    {
+        if( fd_ >= 0 )
+            close( fd_ );
+    }
+
+    bool open( const std::string & filename, std::string * error_msg )
+    {
+        fd_ = ::open( filename.c_str(), O_RDONLY | O_CLOEXEC );
+
+        if( fd_ < 0 )
+        {
+            * error_msg = "cannot open file";
+            return false;
+        }
+
+        struct stat st;
+
+        if( fstat( fd_, & st ) != 0 )
+        {
+            * error_msg = "cannot stat file";
+            return false;
+        }
+
+        size_   = st.st_size;
+
+        auto res = pread( fd_, header_, HEADER_SIZE, 0 );
+
+        if( res < 0 )
+        {
+            * error_msg = "cannot read file";
+            return false;
+        }
+
+        header_size_    = res;
+
+        return true;
+    }
+
+    // served from the header if possible
+    bool read( uint64_t offset, void * dst, size_t n ) const
+    {
+        if( offset + n <= header_size_ )
+        {
+            memcpy( dst, header_ + offset, n );
+            return true;
+        }
+
+        return pread( fd_, dst, n, offset ) == static_cast<ssize_t>( n );
+    }
+
+    uint64_t size() const
+    {
+        return size_;
+    }
+
+    const uint8_t * header() const
+    {
+        return header_;
+    }
+
+    size_t header_size() const
+    {
+        return header_size_;
+    }
+
+private:
+
+    int         fd_;
+    uint64_t    size_;
+    size_t      header_size_;
+    uint8_t     header_[ HEADER_SIZE ];
+};
+
+/**
+ * @brief Walks the chunks of RIFF/WAVE or RF64.
+ *
+ * Unknown chunks (LIST, bext, JUNK, ...) are skipped without reading, so a large LIST in front of the data costs
+ * one more pread. Like sndfile, a data size of 0, 0xFFFFFFFF or beyond the end of file is replaced by the rest of the file.
+ */
+bool probe_wav( const File & f, bool is_rf64, double * duration, std::string * error_msg )
+{
+    bool        has_fmt         = false;
+    uint16_t    format_tag      = 0;
+    uint16_t    block_align     = 0;
+    uint32_t    sample_rate     = 0;
+
+    bool        has_fact        = false;
+    uint64_t    fact_samples    = 0;
+
+    bool        has_ds64        = false;
+    uint64_t    ds64_data_size  = 0;
+
+    bool        has_data        = false;
+    uint64_t    data_size       = 0;
+
+    uint64_t    offset          = 12;
+
+    for( int n = 0; n < MAX_CHUNKS && offset + 8 <= f.size(); ++n )
+    {
+        uint8_t ch[8];
+
+        if( f.read( offset, ch, sizeof( ch ) ) == false )
+            break;
+
+        uint64_t chunk_size = get_le32( ch + 4 );
+
+        auto body = offset + 8;
+
+        if( memcmp( ch, "fmt ", 4 ) == 0 )
+        {
+            uint8_t fmt[26] = { 0 };
+
+            if( chunk_size < 16 || f.read( body, fmt, chunk_size < sizeof( fmt ) ? 16 : sizeof( fmt ) ) == false )
+            {
+                * error_msg = "invalid fmt chunk";
+                return false;
+            }
+
+            has_fmt     = true;
+            format_tag  = get_le16( fmt );
+            sample_rate = get_le32( fmt + 4 );
+            block_align = get_le16( fmt + 12 );
+
+            // the actual format is in the first 2 bytes of the subformat GUID
+            if( format_tag == WAVE_FORMAT_EXTENSIBLE && chunk_size >= sizeof( fmt ) )
+                format_tag  = get_le16( fmt + 24 );
+        }
+        else if( memcmp( ch, "fact", 4 ) == 0 && chunk_size >= 4 )
+        {
+            uint8_t fact[4];
+
+            if( f.read( body, fact, sizeof( fact ) ) )
+            {
+                has_fact        = true;
+                fact_samples    = get_le32( fact );
+            }
+        }
+        else if( memcmp( ch, "ds64", 4 ) == 0 && chunk_size >= 16 )
+        {
+            uint8_t ds64[16];
+
+            if( f.read( body, ds64, sizeof( ds64 ) ) )
+            {
+                has_ds64        = true;
+                ds64_data_size  = get_le64( ds64 + 8 );
+            }
+        }
+        else if( memcmp( ch, "data", 4 ) == 0 )
+        {
+            if( is_rf64 && chunk_size == 0xFFFFFFFF && has_ds64 )
+                chunk_size  = ds64_data_size;
+
+            auto rest = f.size() - body;
+
+            if( chunk_size == 0 || chunk_size == 0xFFFFFFFF || chunk_size > rest )
+                chunk_size  = rest;
+
+            has_data    = true;
+            data_size   = chunk_size;
+
+            // only the compressed formats need the fact chunk, it may follow the data
+            if( has_fmt && ( has_fact || format_tag == WAVE_FORMAT_PCM || format_tag == WAVE_FORMAT_IEEE_FLOAT
+                    || format_tag == WAVE_FORMAT_ALAW || format_tag == WAVE_FORMAT_MULAW ) )
+                break;
+        }
+
+        offset = body + chunk_size + ( chunk_size & 1 );
+    }
+
+    if( has_fmt == false || has_data == false )
+    {
+        * error_msg = "fmt or data chunk not found";
+        return false;
+    }
+
+    if( sample_rate == 0 )
+    {
+        * error_msg = "invalid sample rate";
+        return false;
+    }
+
+    if( format_tag == WAVE_FORMAT_PCM || format_tag == WAVE_FORMAT_IEEE_FLOAT
+            || format_tag == WAVE_FORMAT_ALAW || format_tag == WAVE_FORMAT_MULAW )
+    {
+        if( block_align == 0 )
+        {
+            * error_msg = "invalid block align";
+            return false;
+        }
+
+        * duration = static_cast<double>( data_size / block_align ) / sample_rate;
+
+        return true;
+    }
+
+    if( has_fact == false )
+    {
+        * error_msg = "compressed format " + std::to_string( format_tag ) + " without fact chunk";
+        return false;
+    }
+
+    * duration = static_cast<double>( fact_samples ) / sample_rate;
+
+    return true;
+}
+
+/**
+ * @brief Reads STREAMINFO, which must be the first metadata block.
+ */
+bool probe_flac( const File & f, uint64_t offset, double * duration, std::string * error_msg )
+{
+    uint8_t b[ 4 + 4 + 34 ];
+
+    if( f.read( offset, b, sizeof( b ) ) == false || memcmp( b, "fLaC", 4 ) != 0 )
+    {
+        * error_msg = "invalid FLAC header";
+        return false;
+    }
+
+    if( ( b[4] & 0x7F ) != 0 )
+    {
+        * error_msg = "first metadata block is not STREAMINFO";
+        return false;
+    }
+
+    auto * si = b + 8;
+
+    uint32_t sample_rate = ( si[10] << 12 ) | ( si[11] << 4 ) | ( si[12] >> 4 );
+
+    uint64_t total_samples = ( static_cast<uint64_t>( si[13] & 0x0F ) << 32 ) | get_be32( si + 14 );
+
+    if( sample_rate == 0 || total_samples == 0 )
+    {
+        * error_msg = "number of samples is unknown";
+        return false;
+    }
+
+    * duration = static_cast<double>( total_samples ) / sample_rate;
+
+    return true;
+}
+
+/**
+ * @brief Finds the granule position of the last page of the stream with the serial in the tail of the file.
+ */
+bool find_last_granule( const File & f, uint32_t serial, uint64_t * granule )
+{
+    std::vector<uint8_t> buf;
+
+    for( uint64_t tail_size : { uint64_t( TAIL_SIZE ), uint64_t( MAX_TAIL_SIZE ) } )
+    {
+        auto n = std::min( tail_size, f.size() );
+
+        buf.resize( n );
+
+        if( f.read( f.size() - n, buf.data(), n ) == false )
+            return false;
+
+        for( auto i = static_cast<int64_t>( n ) - 27; i >= 0; --i )
+        {
+            auto * p = buf.data() + i;
+
+            if( p[0] != 'O' || memcmp( p, "OggS", 4 ) != 0 || get_le32( p + 14 ) != serial )
+                continue;
+
+            auto g = get_le64( p + 6 );
+
+            // pages without a finished packet have granule -1
+            if( g == ~uint64_t( 0 ) )
+                continue;
+
+            * granule = g;
+            return true;
+        }
+
+        if( n == f.size() )
+            break;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Identifies Opus or Vorbis by the first packet and reads the granule position of the last page.
+ */
+bool probe_ogg( const File & f, double * duration, std::string * error_msg )
+{
+    auto * h = f.header();
+
+    if( f.header_size() < 27 || f.header_size() < 27u + h[26] )
+    {
+        * error_msg = "incomplete Ogg page";
+        return false;
+    }
+
+    auto num_segments = h[26];
+
+    uint32_t packet_size = 0;
+
+    for( uint32_t i = 0; i < num_segments; ++i )
+    {
+        packet_size += h[ 27 + i ];
+
+        if( h[ 27 + i ] < 255 )
+            break;
+    }
+
+    auto * packet = h + 27 + num_segments;
+
+    if( packet + packet_size > h + f.header_size() )
+    {
+        * error_msg = "incomplete Ogg page";
+        return false;
+    }
+
+    uint32_t sample_rate;
+    uint64_t pre_skip   = 0;
+
+    if( packet_size >= 19 && memcmp( packet, "OpusHead", 8 ) == 0 )
+    {
+        // granule positions of Opus are always at 48 kHz
+        sample_rate = 48000;
+        pre_skip    = get_le16( packet + 10 );
+    }
+    else if( packet_size >= 30 && memcmp( packet, "\x01vorbis", 7 ) == 0 )
+    {
+        sample_rate = get_le32( packet + 12 );
+    }
+    else
+    {
+        * error_msg = "unsupported Ogg codec";
+        return false;
+    }
+
+    if( sample_rate == 0 )
+    {
+        * error_msg = "invalid sample rate";
+        return false;
+    }
+
+    uint64_t granule;
+
+    if( find_last_granule( f, get_le32( h + 14 ), & granule ) == false )
+    {
+        * error_msg = "last Ogg page not found";
+        return false;
+    }
+
+    * duration = granule > pre_skip ? static_cast<double>( granule - pre_skip ) / sample_rate : 0;
+
+    return true;
+}
+
+} // namespace
+
+HeaderDurationGetter::HeaderDurationGetter():
+    gd_( nullptr )
+{
+}
+
+bool HeaderDurationGetter::init(
+        IGetDuration                        * gd,
+        std::string                         * error_msg )
+{
+    if( gd == this )
+    {
+        * error_msg = "gd points to itself";
+        return false;
+    }
+
+    gd_ = gd;
+
+    return true;
+}
+
+double HeaderDurationGetter::get_duration( const std::string & filename )
+{
+    double res;
+
+    std::string error_msg;
+
+    if( probe( filename, & res, & error_msg ) )
+    {
+        probes_.add();
+
+        return res;
+    }
+
+    fallbacks_.add();
+
+    if( gd_ == nullptr )
+        throw std::runtime_error( "cannot probe " + filename + ": " + error_msg );
+
+    return gd_->get_duration( filename );
+}
+
+bool HeaderDurationGetter::probe( const std::string & filename, double * duration, std::string * error_msg )
+{
+    File f;
+
+    if( f.open( filename, error_msg ) == false )
+        return false;
+
+    auto * h = f.header();
+    auto n   = f.header_size();
+
+    if( n >= 12 && memcmp( h + 8, "WAVE", 4 ) == 0 )
+    {
+        if( memcmp( h, "RIFF", 4 ) == 0 )
+            return probe_wav( f, false, duration, error_msg );
+
+        if( memcmp( h, "RF64", 4 ) == 0 )
+            return probe_wav( f, true, duration, error_msg );
+    }
+
+    if( n >= 4 && memcmp( h, "fLaC", 4 ) == 0 )
+        return probe_flac( f, 0, duration, error_msg );
+
+    // FLAC with a leading ID3v2 tag, the size is syncsafe
+    if( n >= 10 && memcmp( h, "ID3", 3 ) == 0 )
+    {
+        uint64_t size = ( ( h[6] & 0x7F ) << 21 ) | ( ( h[7] & 0x7F ) << 14 ) | ( ( h[8] & 0x7F ) << 7 ) | ( h[9] & 0x7F );
+
+        size += ( h[5] & 0x10 ) ? 20 : 10;
+
+        return probe_flac( f, size, duration, error_msg );
+    }
+
+    if( n >= 4 && memcmp( h, "OggS", 4 ) == 0 )
+        return probe_ogg( f, duration, error_msg );
+
+    * error_msg = "unsupported format";
+    return false;
+}
+
+HeaderDurationGetter::Stats HeaderDurationGetter::get_stats() const
+{
+    Stats res;
+
+    res.probes      = probes_.get();
+    res.fallbacks   = fallbacks_.get();
+
+    return res;
+}
+
+} // namespace simple_voip_wrap
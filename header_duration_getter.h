@@ -0,0 +1,84 @@
+/*
+
+Simple VOIP Wrap. Header Duration Getter.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13982 $ $Date:: 2020-10-21 #$ $Author: serge $
+
+#ifndef SIMPLE_VOIP_WRAP__HEADER_DURATION_GETTER_H
+#define SIMPLE_VOIP_WRAP__HEADER_DURATION_GETTER_H
+
+#include <cstdint>                          // uint64_t
+#include <string>                           // std::string
+
+#include "i_get_duration.h"                 // IGetDuration
+#include "metrics.h"                        // Counter
+
+namespace simple_voip_wrap {
+
+/**
+ * @brief Computes play durations from the file header without decoding the file.
+ *
+ * Supported are RIFF/WAVE and RF64 (PCM, float, A-law, mu-law, other formats via the fact chunk), FLAC with STREAMINFO
+ * and Ogg Opus/Vorbis, for which the granule position of the last page is read. A WAV or FLAC file usually costs
+ * a single pread of the first 4 KB, an Ogg file one more pread of its tail. Files which cannot be probed are passed
+ * to another IGetDuration, e.g. one based on sndfile. Thread-safe.
+ */
+class HeaderDurationGetter: virtual public IGetDuration
+{
+public:
+
+    struct Stats
+    {
+        uint64_t    probes;
+        uint64_t    fallbacks;
+    };
+
+public:
+    HeaderDurationGetter();
+
+    // gd may be null, then get_duration throws for the files which cannot be probed
+    bool init(
+            IGetDuration                        * gd,
+            std::string                         * error_msg );
+
+    // interface IGetDuration
+    double get_duration( const std::string & filename ) override;
+
+    // returns false if the format is not supported or the header is incomplete
+    static bool probe( const std::string & filename, double * duration, std::string * error_msg );
+
+    Stats get_stats() const;
+
+private:
+
+    HeaderDurationGetter( const HeaderDurationGetter & )                = delete;
+    HeaderDurationGetter & operator=( const HeaderDurationGetter & )    = delete;
+
+private:
+
+    IGetDuration                * gd_;
+
+    Counter                     probes_;
+    Counter                     fallbacks_;
+};
+
+} // namespace simple_voip_wrap
+
+#endif  // SIMPLE_VOIP_WRAP__HEADER_DURATION_GETTER_H
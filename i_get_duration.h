@@ -25,6 +25,7 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #define SIMPLE_VOIP_WRAP__I_GET_DURATION_H
 
 #include <string>
+#include <cstddef>                          // size_t
 
 namespace simple_voip_wrap {
 
@@ -34,6 +35,12 @@ public:
     virtual ~IGetDuration() {};
 
     virtual double get_duration( const std::string & filename ) = 0;
+
+    // hash is std::hash<std::string> of the filename, already known to the caller, see FilenameTable
+    virtual double get_duration_hashed( const std::string & filename, size_t /* hash */ )
+    {
+        return get_duration( filename );
+    }
 };
 
 } // namespace simple_voip_wrap
@@ -0,0 +1,111 @@
+/*
+
+Load Generator. Init Scenario.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13981 $ $Date:: 2020-10-20 #$ $Author: serge $
+
+#include "init_scenario.h"          // self
+
+#include <sstream>                  // std::istringstream
+
+#define SECTION     "load_generator"
+
+namespace load_generator {
+
+bool init_scenario( Scenario * scenario, const config_reader::ConfigReader & cr, std::string * error_msg )
+{
+    std::string prompts;
+    std::string watch_dirs;
+
+    cr.get_value( & scenario->duration,             SECTION, "duration" );
+    cr.get_value( & scenario->drain_timeout,        SECTION, "drain_timeout" );
+    cr.get_value( & scenario->call_rate,            SECTION, "call_rate" );
+    cr.get_value( & scenario->max_concurrent_calls, SECTION, "max_concurrent_calls" );
+    cr.get_value( & scenario->media_per_call,       SECTION, "media_per_call" );
+    cr.get_value( & scenario->play_probability,     SECTION, "play_probability" );
+    cr.get_value( & prompts,                        SECTION, "prompts" );
+    cr.get_value( & scenario->warm_up_threads,      SECTION, "warm_up_threads" );
+    cr.get_value( & watch_dirs,                     SECTION, "watch_dirs" );
+    cr.get_value( & scenario->record_path,          SECTION, "record_path" );
+    cr.get_value( & scenario->record_duration_min,  SECTION, "record_duration_min" );
+    cr.get_value( & scenario->record_duration_max,  SECTION, "record_duration_max" );
+    cr.get_value( & scenario->party,                SECTION, "party" );
+    cr.get_value( & scenario->voip_config,          SECTION, "voip_config" );
+    cr.get_value( & scenario->num_shards,           SECTION, "num_shards" );
+    cr.get_value( & scenario->max_pending_requests, SECTION, "max_pending_requests" );
+    cr.get_value( & scenario->timer_tick_ms,        SECTION, "timer_tick_ms" );
+    cr.get_value( & scenario->duration_threads,     SECTION, "duration_threads" );
+    cr.get_value( & scenario->speculative_stop_timers,  SECTION, "speculative_stop_timers" );
+    cr.get_value( & scenario->max_filenames,        SECTION, "max_filenames" );
+    cr.get_value( & scenario->max_queued_media,     SECTION, "max_queued_media" );
+    cr.get_value( & scenario->pending_ttl_ms,       SECTION, "pending_ttl_ms" );
+
+    // comma separated list
+    std::istringstream is( prompts );
+    std::string p;
+
+    while( std::getline( is, p, ',' ) )
+    {
+        if( p.empty() == false )
+            scenario->prompts.push_back( p );
+    }
+
+    std::istringstream is_dirs( watch_dirs );
+
+    while( std::getline( is_dirs, p, ',' ) )
+    {
+        if( p.empty() == false )
+            scenario->watch_dirs.push_back( p );
+    }
+
+    if( scenario->call_rate <= 0 )
+    {
+        * error_msg = "call_rate must be positive";
+        return false;
+    }
+
+    if( scenario->max_concurrent_calls == 0 )
+    {
+        * error_msg = "max_concurrent_calls is 0";
+        return false;
+    }
+
+    if( scenario->play_probability > 100 )
+    {
+        * error_msg = "play_probability is greater than 100";
+        return false;
+    }
+
+    if( scenario->play_probability > 0 && scenario->prompts.empty() )
+    {
+        * error_msg = "prompts are empty";
+        return false;
+    }
+
+    if( scenario->record_duration_min <= 0 || scenario->record_duration_max < scenario->record_duration_min )
+    {
+        * error_msg = "invalid record duration range";
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace load_generator
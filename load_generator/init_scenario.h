@@ -0,0 +1,37 @@
+/*
+
+Load Generator. Init Scenario.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13974 $ $Date:: 2020-10-14 #$ $Author: serge $
+
+#ifndef SIMPLE_VOIP_WRAP__LOAD_GENERATOR__INIT_SCENARIO_H
+#define SIMPLE_VOIP_WRAP__LOAD_GENERATOR__INIT_SCENARIO_H
+
+#include "config_reader/config_reader.h"    // config_reader::ConfigReader
+
+#include "scenario.h"                       // Scenario
+
+namespace load_generator {
+
+bool init_scenario( Scenario * scenario, const config_reader::ConfigReader & cr, std::string * error_msg );
+
+} // namespace load_generator
+
+#endif  // SIMPLE_VOIP_WRAP__LOAD_GENERATOR__INIT_SCENARIO_H
@@ -0,0 +1,399 @@
+/*
+
+Load Generator.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13974 $ $Date:: 2020-10-14 #$ $Author: serge $
+
+#include "load_generator.h"         // self
+
+#include <algorithm>                // std::sort
+#include <typeinfo>                 // typeid
+#include <utility>                  // std::move
+
+#include "simple_voip/objects.h"
+#include "simple_voip/object_factory.h"         // simple_voip::create_initiate_call_request
+#include "utils/mutex_helper.h"                 // MUTEX_SCOPE_LOCK
+
+#include "simple_voip_wrap/object_factory.h"    // simple_voip::wrap::create_PlayFileRequest
+#include "simple_voip_wrap/type_dispatcher.h"   // TypeDispatcher
+
+namespace load_generator {
+
+LoadGenerator::LoadGenerator():
+    voips_( nullptr ),
+    req_id_gen_( nullptr ),
+    gd_( nullptr ),
+    report_()
+{
+}
+
+LoadGenerator::~LoadGenerator()
+{
+    shutdown();
+}
+
+bool LoadGenerator::init(
+        const Scenario                      & scenario,
+        simple_voip::ISimpleVoip            * voips,
+        utils::IRequestIdGen                * req_id_gen,
+        simple_voip_wrap::IGetDuration      * gd,
+        std::string                         * error_msg )
+{
+    if( voips == nullptr || req_id_gen == nullptr || gd == nullptr )
+    {
+        * error_msg = "parameter is null";
+        return false;
+    }
+
+    scenario_   = scenario;
+    voips_      = voips;
+    req_id_gen_ = req_id_gen;
+    gd_         = gd;
+
+    rand_.seed( std::random_device()() );
+
+    return true;
+}
+
+void LoadGenerator::consume( const simple_voip::CallbackObject * obj )
+{
+    {
+        MUTEX_SCOPE_LOCK( mutex_ );
+
+        queue_.push_back( obj );
+    }
+
+    cond_.notify_one();
+}
+
+void LoadGenerator::run()
+{
+    auto start      = Clock::now();
+    auto end        = start + std::chrono::seconds( scenario_.duration );
+    auto drain_end  = end + std::chrono::seconds( scenario_.drain_timeout );
+
+    std::deque<const simple_voip::CallbackObject*>  queue;
+
+    while( true )
+    {
+        auto now = Clock::now();
+
+        if( now < end )
+        {
+            start_calls( std::chrono::duration<double>( now - start ).count() );
+        }
+        else if( get_num_active_calls() == 0 || now >= drain_end )
+        {
+            break;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock( mutex_ );
+
+            cond_.wait_for( lock, std::chrono::milliseconds( 10 ), [this]{ return queue_.empty() == false; } );
+
+            queue.swap( queue_ );
+        }
+
+        for( auto * obj : queue )
+        {
+            handle( obj );
+
+            delete obj;
+        }
+
+        queue.clear();
+    }
+
+    // calls which haven't ended during the drain timeout are dropped
+    std::vector<uint32_t> call_ids;
+
+    for( auto & c : calls_ )
+        call_ids.push_back( c.first );
+
+    for( auto call_id : call_ids )
+        drop_call( call_id );
+
+    std::sort( stop_delays_.begin(), stop_delays_.end() );
+
+    MUTEX_SCOPE_LOCK( mutex_ );
+
+    report_.duration = std::chrono::duration<double>( Clock::now() - start ).count();
+
+    if( stop_delays_.empty() == false )
+    {
+        double sum = 0;
+
+        for( auto d : stop_delays_ )
+            sum += d;
+
+        report_.stop_delay_mean = sum / stop_delays_.size();
+        report_.stop_delay_p50  = stop_delays_[ stop_delays_.size() * 50 / 100 ];
+        report_.stop_delay_p99  = stop_delays_[ stop_delays_.size() * 99 / 100 ];
+        report_.stop_delay_min  = stop_delays_.front();
+        report_.stop_delay_max  = stop_delays_.back();
+    }
+}
+
+void LoadGenerator::shutdown()
+{
+    std::deque<const simple_voip::CallbackObject*>  queue;
+
+    {
+        MUTEX_SCOPE_LOCK( mutex_ );
+
+        queue.swap( queue_ );
+    }
+
+    for( auto * obj : queue )
+        delete obj;
+}
+
+LoadGenerator::Report LoadGenerator::get_report() const
+{
+    MUTEX_SCOPE_LOCK( mutex_ );
+
+    return report_;
+}
+
+void LoadGenerator::handle( const simple_voip::CallbackObject * obj )
+{
+    typedef simple_voip_wrap::TypeDispatcher<simple_voip::CallbackObject,
+            simple_voip::wrap::PlayFileStopped,
+            simple_voip::wrap::RecordFileStopped,
+            simple_voip::InitiateCallResponse,
+            simple_voip::Connected,
+            simple_voip::ErrorResponse,
+            simple_voip::RejectResponse,
+            simple_voip::Failed,
+            simple_voip::ConnectionLost>    Dispatcher;
+
+    ++report_.messages_received;
+
+    switch( Dispatcher::get_tag( * obj ) )
+    {
+    case Dispatcher::tag<simple_voip::wrap::PlayFileStopped>():
+    {
+        auto * m = static_cast<const simple_voip::wrap::PlayFileStopped*>( obj );
+        handle_media_stopped( m->call_id, m->req_id, m->errorcode );
+    }
+    break;
+
+    case Dispatcher::tag<simple_voip::wrap::RecordFileStopped>():
+    {
+        auto * m = static_cast<const simple_voip::wrap::RecordFileStopped*>( obj );
+        handle_media_stopped( m->call_id, m->req_id, m->errorcode );
+    }
+    break;
+
+    case Dispatcher::tag<simple_voip::InitiateCallResponse>():
+    {
+        auto * m = static_cast<const simple_voip::InitiateCallResponse*>( obj );
+        handle_initiate_call_response( m->req_id, m->call_id );
+    }
+    break;
+
+    case Dispatcher::tag<simple_voip::Connected>():
+        handle_connected( static_cast<const simple_voip::Connected*>( obj )->call_id );
+        break;
+
+    case Dispatcher::tag<simple_voip::ErrorResponse>():
+        handle_initiate_call_error( static_cast<const simple_voip::ErrorResponse*>( obj )->req_id );
+        break;
+
+    case Dispatcher::tag<simple_voip::RejectResponse>():
+        handle_initiate_call_error( static_cast<const simple_voip::RejectResponse*>( obj )->req_id );
+        break;
+
+    case Dispatcher::tag<simple_voip::Failed>():
+        handle_call_end( static_cast<const simple_voip::Failed*>( obj )->call_id, false );
+        break;
+
+    case Dispatcher::tag<simple_voip::ConnectionLost>():
+        handle_call_end( static_cast<const simple_voip::ConnectionLost*>( obj )->call_id, true );
+        break;
+
+    default:
+        // dialing, ringing, drop responses etc. are not relevant
+        break;
+    }
+}
+
+void LoadGenerator::handle_initiate_call_response( uint32_t req_id, uint32_t call_id )
+{
+    if( initiate_req_ids_.erase( req_id ) == 0 )
+        return;
+
+    // the call is started when it's connected
+    Call c = { 0, 0, Clock::time_point(), 0 };
+
+    calls_.insert( std::make_pair( call_id, c ) );
+}
+
+void LoadGenerator::handle_initiate_call_error( uint32_t req_id )
+{
+    // errors of other requests are ignored, the media errors come as PlayFileStopped/RecordFileStopped
+    if( initiate_req_ids_.erase( req_id ) == 0 )
+        return;
+
+    ++report_.calls_failed;
+}
+
+void LoadGenerator::handle_connected( uint32_t call_id )
+{
+    auto it = calls_.find( call_id );
+
+    if( it == calls_.end() )
+        return;
+
+    ++report_.calls_connected;
+
+    start_media( call_id, it->second );
+}
+
+void LoadGenerator::handle_call_end( uint32_t call_id, bool is_lost )
+{
+    if( calls_.erase( call_id ) == 0 )
+        return;
+
+    if( is_lost )
+        ++report_.calls_lost;
+    else
+        ++report_.calls_failed;
+}
+
+void LoadGenerator::handle_media_stopped( uint32_t call_id, uint32_t req_id, uint32_t errorcode )
+{
+    auto it = calls_.find( call_id );
+
+    if( it == calls_.end() )
+        return;
+
+    auto & call = it->second;
+
+    if( call.media_req_id != req_id )
+        return;
+
+    if( errorcode != 0 )
+    {
+        ++report_.media_failed;
+
+        // the call is lost, ConnectionLost follows
+        if( errorcode == simple_voip::wrap::ErrorCodes::CALL_ENDED )
+            return;
+
+        drop_call( call_id );
+        return;
+    }
+
+    ++report_.media_ok;
+
+    auto actual = std::chrono::duration<double>( Clock::now() - call.media_start ).count();
+
+    stop_delays_.push_back( ( actual - call.expected_duration ) * 1000 );
+
+    if( call.num_media < scenario_.media_per_call )
+    {
+        start_media( call_id, call );
+    }
+    else
+    {
+        ++report_.calls_completed;
+
+        drop_call( call_id );
+    }
+}
+
+void LoadGenerator::start_calls( double elapsed )
+{
+    auto num_due = static_cast<uint64_t>( elapsed * scenario_.call_rate );
+
+    while( report_.calls_started < num_due && get_num_active_calls() < scenario_.max_concurrent_calls )
+    {
+        auto req_id = req_id_gen_->get_next_request_id();
+
+        initiate_req_ids_.insert( req_id );
+
+        ++report_.calls_started;
+
+        send( simple_voip::create_initiate_call_request( req_id, scenario_.party ) );
+
+        auto num_active = get_num_active_calls();
+
+        if( num_active > report_.max_concurrent_calls )
+            report_.max_concurrent_calls = num_active;
+    }
+}
+
+void LoadGenerator::start_media( uint32_t call_id, Call & call )
+{
+    auto req_id = req_id_gen_->get_next_request_id();
+
+    ++call.num_media;
+
+    call.media_req_id   = req_id;
+    call.media_start    = Clock::now();
+
+    bool is_play = std::uniform_int_distribution<uint32_t>( 1, 100 )( rand_ ) <= scenario_.play_probability;
+
+    if( is_play )
+    {
+        auto & prompt = scenario_.prompts[ std::uniform_int_distribution<size_t>( 0, scenario_.prompts.size() - 1 )( rand_ ) ];
+
+        call.expected_duration  = gd_->get_duration( prompt );
+
+        ++report_.plays_started;
+
+        send( simple_voip::wrap::create_PlayFileRequest( req_id, call_id, prompt ) );
+    }
+    else
+    {
+        auto duration = std::uniform_real_distribution<double>( scenario_.record_duration_min, scenario_.record_duration_max )( rand_ );
+
+        auto filename = scenario_.record_path + "/rec_" + std::to_string( call_id ) + "_" + std::to_string( call.num_media ) + ".wav";
+
+        call.expected_duration  = duration;
+
+        ++report_.records_started;
+
+        send( simple_voip::wrap::create_RecordFileRequest( req_id, call_id, std::move( filename ), duration ) );
+    }
+}
+
+void LoadGenerator::drop_call( uint32_t call_id )
+{
+    calls_.erase( call_id );
+
+    send( simple_voip::create_drop_request( req_id_gen_->get_next_request_id(), call_id ) );
+}
+
+uint32_t LoadGenerator::get_num_active_calls() const
+{
+    return initiate_req_ids_.size() + calls_.size();
+}
+
+void LoadGenerator::send( const simple_voip::ForwardObject * req )
+{
+    ++report_.messages_sent;
+
+    voips_->consume( req );
+}
+
+} // namespace load_generator
@@ -0,0 +1,161 @@
+/*
+
+Load Generator.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13974 $ $Date:: 2020-10-14 #$ $Author: serge $
+
+#ifndef SIMPLE_VOIP_WRAP__LOAD_GENERATOR__LOAD_GENERATOR_H
+#define SIMPLE_VOIP_WRAP__LOAD_GENERATOR__LOAD_GENERATOR_H
+
+#include <mutex>                                // std::mutex
+#include <condition_variable>                   // std::condition_variable
+#include <deque>                                // std::deque
+#include <vector>                               // std::vector
+#include <unordered_map>                        // std::unordered_map
+#include <unordered_set>                        // std::unordered_set
+#include <chrono>                               // std::chrono
+#include <random>                               // std::mt19937
+
+#include "simple_voip/i_simple_voip.h"          // simple_voip::ISimpleVoip
+#include "simple_voip/i_simple_voip_callback.h" // simple_voip::ISimpleVoipCallback
+#include "utils/i_request_id_gen.h"             // utils::IRequestIdGen
+
+#include "simple_voip_wrap/i_get_duration.h"    // IGetDuration
+
+#include "scenario.h"                           // Scenario
+
+namespace load_generator {
+
+/**
+ * @brief Runs calls with plays and records through Wrap according to a Scenario.
+ *
+ * Notifications are queued by consume() and processed by the thread which calls run(),
+ * so the requests are never sent from the thread of the engine.
+ */
+class LoadGenerator: virtual public simple_voip::ISimpleVoipCallback
+{
+public:
+
+    typedef std::chrono::steady_clock   Clock;
+
+    struct Report
+    {
+        double      duration;           // seconds
+
+        uint64_t    calls_started;
+        uint64_t    calls_connected;
+        uint64_t    calls_failed;       // rejected, error or not connected
+        uint64_t    calls_lost;
+        uint64_t    calls_completed;    // all media done and dropped
+        uint32_t    max_concurrent_calls;
+
+        uint64_t    plays_started;
+        uint64_t    records_started;
+        uint64_t    media_ok;
+        uint64_t    media_failed;
+
+        uint64_t    messages_sent;
+        uint64_t    messages_received;
+
+        // delay of the stop notification relative to the duration of the media, ms
+        double      stop_delay_mean;
+        double      stop_delay_p50;
+        double      stop_delay_p99;
+        double      stop_delay_max;
+        double      stop_delay_min;
+    };
+
+public:
+    LoadGenerator();
+    ~LoadGenerator();
+
+    bool init(
+            const Scenario                      & scenario,
+            simple_voip::ISimpleVoip            * voips,
+            utils::IRequestIdGen                * req_id_gen,
+            simple_voip_wrap::IGetDuration      * gd,
+            std::string                         * error_msg );
+
+    // interface ISimpleVoipCallback
+    void consume( const simple_voip::CallbackObject * obj ) override;
+
+    // returns when the scenario is complete
+    void run();
+
+    // deletes the notifications which have arrived after run() has returned, call when the engine and Wrap are stopped
+    void shutdown();
+
+    Report get_report() const;
+
+private:
+
+    struct Call
+    {
+        uint32_t            num_media;          // media started so far
+        uint32_t            media_req_id;
+        Clock::time_point   media_start;
+        double              expected_duration;  // seconds
+    };
+
+    typedef std::unordered_map<uint32_t, Call>  MapCallIdToCall;
+
+private:
+
+    void handle( const simple_voip::CallbackObject * obj );
+
+    void handle_initiate_call_response( uint32_t req_id, uint32_t call_id );
+    void handle_initiate_call_error( uint32_t req_id );
+    void handle_connected( uint32_t call_id );
+    void handle_call_end( uint32_t call_id, bool is_lost );
+    void handle_media_stopped( uint32_t call_id, uint32_t req_id, uint32_t errorcode );
+
+    void start_calls( double elapsed );
+    void start_media( uint32_t call_id, Call & call );
+    void drop_call( uint32_t call_id );
+
+    uint32_t get_num_active_calls() const;
+
+    void send( const simple_voip::ForwardObject * req );
+
+private:
+    mutable std::mutex          mutex_;
+    std::condition_variable     cond_;
+
+    std::deque<const simple_voip::CallbackObject*>  queue_;     // protected by mutex_
+
+    Scenario                    scenario_;
+
+    simple_voip::ISimpleVoip    * voips_;
+    utils::IRequestIdGen        * req_id_gen_;
+    simple_voip_wrap::IGetDuration  * gd_;
+
+    std::mt19937                rand_;
+
+    // owned by the thread of run()
+    std::unordered_set<uint32_t>    initiate_req_ids_;
+    MapCallIdToCall             calls_;
+
+    Report                      report_;
+    std::vector<double>         stop_delays_;
+};
+
+} // namespace load_generator
+
+#endif  // SIMPLE_VOIP_WRAP__LOAD_GENERATOR__LOAD_GENERATOR_H
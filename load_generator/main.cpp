@@ -0,0 +1,226 @@
+/*
+
+Load Generator.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13981 $ $Date:: 2020-10-20 #$ $Author: serge $
+
+#include <iostream>         // cout
+#include <thread>           // std::thread
+#include <functional>       // std::bind
+
+#include "simple_voip_dummy/dummy.h"            // simple_voip_dummy::Dummy
+#include "simple_voip_dummy/init_config.h"      // simple_voip_dummy::init_config
+#include "config_reader/config_reader.h"        // config_reader::ConfigReader
+#include "utils/dummy_logger.h"                 // dummy_logger::set_log_level
+#include "utils/request_id_gen.h"               // RequestIdGen
+#include "scheduler/scheduler.h"                // Scheduler
+#include "wav_tools/get_wav_duration.h"         // get_wav_duration()
+
+#include "simple_voip_wrap/wrap.h"              // simple_voip_wrap::Wrap
+#include "simple_voip_wrap/caching_duration_getter.h"   // CachingDurationGetter
+#include "simple_voip_wrap/duration_warmer.h"   // DurationWarmer
+#include "simple_voip_wrap/duration_cache_watcher.h"    // DurationCacheWatcher
+
+#include "init_scenario.h"                      // init_scenario
+#include "load_generator.h"                     // LoadGenerator
+
+class DurationGetter: virtual public simple_voip_wrap::IGetDuration
+{
+public:
+    double get_duration( const std::string & filename ) override
+    {
+        return wav_tools::get_wav_duration( filename );
+    }
+};
+
+void print_report( const load_generator::LoadGenerator::Report & r, const simple_voip_wrap::PendingStats & ps )
+{
+    std::cout
+        << "duration             " << r.duration << " sec\n"
+        << "calls started        " << r.calls_started << "\n"
+        << "calls connected      " << r.calls_connected << "\n"
+        << "calls failed         " << r.calls_failed << "\n"
+        << "calls lost           " << r.calls_lost << "\n"
+        << "calls completed      " << r.calls_completed << "\n"
+        << "max concurrent calls " << r.max_concurrent_calls << "\n"
+        << "plays started        " << r.plays_started << "\n"
+        << "records started      " << r.records_started << "\n"
+        << "media ok             " << r.media_ok << "\n"
+        << "media failed         " << r.media_failed << "\n"
+        << "throughput           " << r.calls_started / r.duration << " calls/sec, "
+                << ( r.plays_started + r.records_started ) / r.duration << " media/sec, "
+                << ( r.messages_sent + r.messages_received ) / r.duration << " messages/sec\n"
+        << "stop delay, ms       min " << r.stop_delay_min << ", mean " << r.stop_delay_mean
+                << ", p50 " << r.stop_delay_p50 << ", p99 " << r.stop_delay_p99 << ", max " << r.stop_delay_max << "\n"
+        << "wrap high-water      pending requests " << ps.max_num_pending << ", active media " << ps.max_num_active_media << "\n"
+        << "wrap left over       calls " << ps.num_calls << ", pending requests " << ps.num_pending << ", active media " << ps.num_active_media << std::endl;
+}
+
+int main( int argc, char **argv )
+{
+    if( argc < 2 )
+    {
+        std::cout << "usage: load_generator <scenario.ini>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    dummy_logger::set_log_level( log_levels_log4j::WARN );
+
+    std::string error_msg;
+
+    load_generator::Scenario scenario;
+
+    {
+        config_reader::ConfigReader cr;
+
+        if( cr.init( argv[1] ) == false )
+        {
+            std::cout << "cannot read " << argv[1] << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        if( load_generator::init_scenario( & scenario, cr, & error_msg ) == false )
+        {
+            std::cout << "invalid scenario: " << error_msg << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    simple_voip_dummy::Config config;
+
+    {
+        config_reader::ConfigReader cr;
+
+        if( cr.init( scenario.voip_config ) == false )
+        {
+            std::cout << "cannot read " << scenario.voip_config << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        simple_voip_dummy::init_config( & config, cr );
+    }
+
+    simple_voip_dummy::Dummy        dialer;
+    scheduler::Scheduler            sched( scheduler::Duration( std::chrono::milliseconds( 1 ) ) );
+    simple_voip_wrap::Wrap          wrap;
+    utils::RequestIdGen             req_id_gen;
+    DurationGetter                  dg;
+    simple_voip_wrap::CachingDurationGetter cdg;
+    simple_voip_wrap::DurationCacheWatcher  watcher;
+    load_generator::LoadGenerator   gen;
+
+    auto log_id_wrap        = dummy_logger::register_module( "Wrap" );
+    auto log_id_dummy       = dummy_logger::register_module( "SimpleVoipDummy" );
+    auto log_id_call        = dummy_logger::register_module( "Call" );
+    auto log_id_sched       = dummy_logger::register_module( "Scheduler" );
+
+    sched.init_log( log_id_sched );
+
+    if( dialer.init( log_id_dummy, log_id_call, config, & wrap, & sched, & error_msg ) == false )
+    {
+        std::cout << "cannot initialize voip module: " << error_msg << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // the watcher keeps the cache valid, so the hits don't need to stat the files
+    bool must_watch = scenario.watch_dirs.empty() == false;
+
+    if( cdg.init( & dg, 1000, must_watch == false, & error_msg ) == false )
+    {
+        std::cout << "cannot initialize CachingDurationGetter: " << error_msg << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if( must_watch && watcher.init( & cdg, scenario.watch_dirs, std::chrono::milliseconds( 100 ), true, & error_msg ) == false )
+    {
+        std::cout << "cannot initialize DurationCacheWatcher: " << error_msg << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if( scenario.warm_up_threads > 0 )
+    {
+        simple_voip_wrap::DurationWarmer warmer;
+
+        if( warmer.init( & cdg, scenario.warm_up_threads, & error_msg ) == false )
+        {
+            std::cout << "cannot initialize DurationWarmer: " << error_msg << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        for( auto & p : scenario.prompts )
+            warmer.add_file( p );
+
+        simple_voip_wrap::DurationWarmer::Progress progress;
+
+        warmer.run( & progress, std::chrono::seconds( 1 ),
+                []( const simple_voip_wrap::DurationWarmer::Progress & p )
+                {
+                    std::cout << "warm-up: " << p.num_done << " of " << p.num_files << ", errors " << p.num_errors
+                            << ", " << p.files_per_sec << " files/sec" << std::endl;
+                },
+                & error_msg );
+    }
+
+    simple_voip_wrap::Config wrap_config;
+
+    wrap_config.num_shards              = scenario.num_shards;
+    wrap_config.max_pending_requests    = scenario.max_pending_requests;
+    wrap_config.timer_tick_ms           = scenario.timer_tick_ms;
+    wrap_config.duration_threads        = scenario.duration_threads;
+    wrap_config.speculative_stop_timers = scenario.speculative_stop_timers;
+    wrap_config.max_filenames           = scenario.max_filenames;
+    wrap_config.max_queued_media        = scenario.max_queued_media;
+    wrap_config.pending_ttl_ms          = scenario.pending_ttl_ms;
+
+    if( wrap.init( log_id_wrap, wrap_config, & dialer, & gen, & sched, & req_id_gen, & cdg, & error_msg ) == false )
+    {
+        std::cout << "cannot initialize Wrap: " << error_msg << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if( gen.init( scenario, & wrap, & req_id_gen, & cdg, & error_msg ) == false )
+    {
+        std::cout << "cannot initialize LoadGenerator: " << error_msg << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    dialer.start();
+
+    std::thread t( std::bind( & load_generator::LoadGenerator::run, & gen ) );
+
+    sched.run();
+
+    t.join();
+
+    auto pending_stats = wrap.get_pending_stats();
+    auto metrics       = wrap.get_metrics();
+
+    dialer.shutdown();
+    wrap.shutdown();
+    sched.shutdown();
+    watcher.shutdown();
+    gen.shutdown();
+
+    print_report( gen.get_report(), pending_stats );
+
+    std::cout << "\nwrap metrics\n" << metrics.to_text();
+
+    return 0;
+}
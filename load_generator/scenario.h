@@ -0,0 +1,66 @@
+/*
+
+Load Generator. Scenario.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13981 $ $Date:: 2020-10-20 #$ $Author: serge $
+
+#ifndef SIMPLE_VOIP_WRAP__LOAD_GENERATOR__SCENARIO_H
+#define SIMPLE_VOIP_WRAP__LOAD_GENERATOR__SCENARIO_H
+
+#include <string>           // std::string
+#include <vector>           // std::vector
+#include <cstdint>          // uint32_t
+
+namespace load_generator {
+
+struct Scenario
+{
+    uint32_t    duration;               // seconds, no new calls are started afterwards
+    uint32_t    drain_timeout;          // seconds to wait for the active calls to end
+    double      call_rate;              // new calls per second
+    uint32_t    max_concurrent_calls;
+    uint32_t    media_per_call;         // plays and records done one after another, then the call is dropped
+    uint32_t    play_probability;       // percent of the media which are plays, the rest are records
+
+    std::vector<std::string>    prompts;    // files to play, chosen at random
+    uint32_t    warm_up_threads;        // durations of the prompts are probed before the start, 0 - no warm-up
+    std::vector<std::string>    watch_dirs; // changes of the prompts in these directories invalidate the cache, empty - cache checks each file
+
+    std::string record_path;            // directory for recorded files
+    double      record_duration_min;    // seconds
+    double      record_duration_max;
+
+    std::string party;                  // number to call
+    std::string voip_config;            // config of simple_voip_dummy
+
+    // Wrap settings, see simple_voip_wrap::Config
+    uint32_t    num_shards;
+    uint32_t    max_pending_requests;
+    uint32_t    timer_tick_ms;
+    uint32_t    duration_threads;
+    bool        speculative_stop_timers;
+    uint32_t    max_filenames;
+    uint32_t    max_queued_media;
+    uint32_t    pending_ttl_ms;
+};
+
+} // namespace load_generator
+
+#endif  // SIMPLE_VOIP_WRAP__LOAD_GENERATOR__SCENARIO_H
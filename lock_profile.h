@@ -0,0 +1,152 @@
+/*
+
+Simple VOIP Wrap. Lock Profile.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13973 $ $Date:: 2020-10-13 #$ $Author: serge $
+
+#ifndef SIMPLE_VOIP_WRAP__LOCK_PROFILE_H
+#define SIMPLE_VOIP_WRAP__LOCK_PROFILE_H
+
+#include <mutex>                            // std::mutex
+#include <atomic>                           // std::atomic
+#include <chrono>                           // std::chrono
+#include <cstdint>                          // uint64_t
+
+namespace simple_voip_wrap {
+
+struct LockStats
+{
+    uint64_t    num_locks;
+    uint64_t    wait_ns;        // total time spent waiting for the mutex
+    uint64_t    hold_ns;        // total time the mutex was held
+    uint64_t    max_wait_ns;
+};
+
+/**
+ * @brief Wait and hold time counters of one mutex, updated by ProfiledLock. Thread-safe.
+ */
+class LockProfile
+{
+public:
+    LockProfile():
+        num_locks_( 0 ),
+        wait_ns_( 0 ),
+        hold_ns_( 0 ),
+        max_wait_ns_( 0 )
+    {
+    }
+
+    void add( uint64_t wait_ns, uint64_t hold_ns )
+    {
+        num_locks_.fetch_add( 1, std::memory_order_relaxed );
+        wait_ns_.fetch_add( wait_ns, std::memory_order_relaxed );
+        hold_ns_.fetch_add( hold_ns, std::memory_order_relaxed );
+
+        auto max = max_wait_ns_.load( std::memory_order_relaxed );
+
+        while( wait_ns > max && max_wait_ns_.compare_exchange_weak( max, wait_ns, std::memory_order_relaxed ) == false )
+        {
+        }
+    }
+
+    LockStats get() const
+    {
+        LockStats res;
+
+        res.num_locks   = num_locks_.load( std::memory_order_relaxed );
+        res.wait_ns     = wait_ns_.load( std::memory_order_relaxed );
+        res.hold_ns     = hold_ns_.load( std::memory_order_relaxed );
+        res.max_wait_ns = max_wait_ns_.load( std::memory_order_relaxed );
+
+        return res;
+    }
+
+    void reset()
+    {
+        num_locks_.store( 0, std::memory_order_relaxed );
+        wait_ns_.store( 0, std::memory_order_relaxed );
+        hold_ns_.store( 0, std::memory_order_relaxed );
+        max_wait_ns_.store( 0, std::memory_order_relaxed );
+    }
+
+private:
+    std::atomic<uint64_t>   num_locks_;
+    std::atomic<uint64_t>   wait_ns_;
+    std::atomic<uint64_t>   hold_ns_;
+    std::atomic<uint64_t>   max_wait_ns_;
+};
+
+/**
+ * @brief Scoped lock which reports its wait and hold time to a LockProfile.
+ *
+ * Without a profile it is a plain scoped lock and doesn't read the clock.
+ */
+class ProfiledLock
+{
+public:
+    ProfiledLock( std::mutex & mutex, LockProfile * profile ):
+        mutex_( mutex ),
+        profile_( profile )
+    {
+        if( profile_ == nullptr )
+        {
+            mutex_.lock();
+            return;
+        }
+
+        auto start  = std::chrono::steady_clock::now();
+
+        mutex_.lock();
+
+        locked_     = std::chrono::steady_clock::now();
+        wait_ns_    = std::chrono::duration_cast<std::chrono::nanoseconds>( locked_ - start ).count();
+    }
+
+    ~ProfiledLock()
+    {
+        if( profile_ == nullptr )
+        {
+            mutex_.unlock();
+            return;
+        }
+
+        auto hold_ns = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - locked_ ).count();
+
+        mutex_.unlock();
+
+        profile_->add( wait_ns_, hold_ns );
+    }
+
+private:
+
+    ProfiledLock( const ProfiledLock & )                = delete;
+    ProfiledLock & operator=( const ProfiledLock & )    = delete;
+
+private:
+    std::mutex                              & mutex_;
+    LockProfile                             * profile_;
+
+    std::chrono::steady_clock::time_point   locked_;
+    uint64_t                                wait_ns_;
+};
+
+} // namespace simple_voip_wrap
+
+#endif  // SIMPLE_VOIP_WRAP__LOCK_PROFILE_H
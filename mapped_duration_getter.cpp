@@ -0,0 +1,219 @@
+/*
+
+Simple VOIP Wrap. Mapped Duration Getter.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13979 $ $Date:: 2020-10-18 #$ $Author: serge $
+
+#include "mapped_duration_getter.h"     // self
+
+#include <sys/mman.h>                   // mmap
+#include <sys/stat.h>                   // fstat
+#include <fcntl.h>                      // open
+#include <unistd.h>                     // close
+#include <cstring>                      // memcmp
+
+namespace simple_voip_wrap {
+
+MappedDurationGetter::MappedDurationGetter():
+    gd_( nullptr ),
+    data_( nullptr ),
+    size_( 0 ),
+    header_( nullptr ),
+    buckets_( nullptr ),
+    entries_( nullptr ),
+    names_( nullptr )
+{
+}
+
+MappedDurationGetter::~MappedDurationGetter()
+{
+    if( data_ != nullptr )
+        munmap( data_, size_ );
+}
+
+bool MappedDurationGetter::init(
+        const std::string                   & index_filename,
+        IGetDuration                        * gd,
+        std::string                         * error_msg )
+{
+    if( gd == nullptr )
+    {
+        * error_msg = "gd is null";
+        return false;
+    }
+
+    if( data_ != nullptr )
+    {
+        * error_msg = "already initialized";
+        return false;
+    }
+
+    auto fd = open( index_filename.c_str(), O_RDONLY );
+
+    if( fd < 0 )
+    {
+        * error_msg = "cannot open " + index_filename;
+        return false;
+    }
+
+    struct stat st;
+
+    if( fstat( fd, & st ) != 0 || st.st_size < static_cast<off_t>( sizeof( duration_index::Header ) ) )
+    {
+        close( fd );
+
+        * error_msg = "index is too small: " + index_filename;
+        return false;
+    }
+
+    // prefault the pages, so that the first lookups don't hit the disk
+    auto * data = mmap( nullptr, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0 );
+
+    // the mapping stays valid after close
+    close( fd );
+
+    if( data == MAP_FAILED )
+    {
+        * error_msg = "cannot map " + index_filename;
+        return false;
+    }
+
+    data_   = data;
+    size_   = st.st_size;
+
+    if( validate( error_msg ) == false )
+    {
+        munmap( data_, size_ );
+
+        data_   = nullptr;
+        size_   = 0;
+
+        * error_msg += ": " + index_filename;
+        return false;
+    }
+
+    gd_     = gd;
+
+    return true;
+}
+
+bool MappedDurationGetter::validate( std::string * error_msg )
+{
+    auto * base = static_cast<const char*>( data_ );
+
+    auto * h = reinterpret_cast<const duration_index::Header*>( base );
+
+    if( memcmp( h->magic, duration_index::MAGIC, sizeof( h->magic ) ) != 0 )
+    {
+        * error_msg = "not a duration index";
+        return false;
+    }
+
+    if( h->version != duration_index::VERSION )
+    {
+        * error_msg = "unsupported version " + std::to_string( h->version );
+        return false;
+    }
+
+    if( h->num_buckets == 0 || ( h->num_buckets & ( h->num_buckets - 1 ) ) != 0 || h->num_buckets < h->num_entries * 2ull )
+    {
+        * error_msg = "invalid number of buckets";
+        return false;
+    }
+
+    auto names_offset = duration_index::get_names_offset( h->num_buckets, h->num_entries );
+
+    if( names_offset + h->names_size != size_ )
+    {
+        * error_msg = "invalid size";
+        return false;
+    }
+
+    header_     = h;
+    buckets_    = reinterpret_cast<const uint32_t*>( base + sizeof( duration_index::Header ) );
+    entries_    = reinterpret_cast<const duration_index::Entry*>( base + duration_index::get_entries_offset( h->num_buckets ) );
+    names_      = base + names_offset;
+
+    return true;
+}
+
+double MappedDurationGetter::get_duration( const std::string & filename )
+{
+    double res;
+
+    if( find( filename, & res ) )
+    {
+        hits_.add();
+
+        return res;
+    }
+
+    misses_.add();
+
+    return gd_->get_duration( filename );
+}
+
+bool MappedDurationGetter::find( const std::string & filename, double * duration ) const
+{
+    if( header_ == nullptr || header_->num_entries == 0 )
+        return false;
+
+    auto hash = duration_index::get_hash( filename.data(), filename.size() );
+
+    auto mask = header_->num_buckets - 1;
+
+    auto b = static_cast<uint32_t>( hash ) & mask;
+
+    // the table is at most half full, the limit protects only against a corrupt file
+    for( uint32_t n = 0; n < header_->num_buckets && buckets_[b] != 0; ++n )
+    {
+        auto i = buckets_[b] - 1;
+
+        if( i < header_->num_entries )
+        {
+            auto & e = entries_[i];
+
+            if( e.hash == hash && e.name_size == filename.size()
+                    && e.name_offset + e.name_size <= header_->names_size
+                    && memcmp( names_ + e.name_offset, filename.data(), e.name_size ) == 0 )
+            {
+                * duration  = e.duration;
+                return true;
+            }
+        }
+
+        b = ( b + 1 ) & mask;
+    }
+
+    return false;
+}
+
+MappedDurationGetter::Stats MappedDurationGetter::get_stats() const
+{
+    Stats res;
+
+    res.hits    = hits_.get();
+    res.misses  = misses_.get();
+    res.size    = header_ ? header_->num_entries : 0;
+
+    return res;
+}
+
+} // namespace simple_voip_wrap
@@ -0,0 +1,95 @@
+/*
+
+Simple VOIP Wrap. Mapped Duration Getter.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13979 $ $Date:: 2020-10-18 #$ $Author: serge $
+
+#ifndef SIMPLE_VOIP_WRAP__MAPPED_DURATION_GETTER_H
+#define SIMPLE_VOIP_WRAP__MAPPED_DURATION_GETTER_H
+
+#include <cstdint>                          // uint32_t
+#include <cstddef>                          // size_t
+
+#include "i_get_duration.h"                 // IGetDuration
+#include "duration_index.h"                 // duration_index::Header
+#include "metrics.h"                        // Counter
+
+namespace simple_voip_wrap {
+
+/**
+ * @brief Looks up play durations in a prebuilt index, see duration_index.h.
+ *
+ * The index is mapped into memory and prefaulted at init, lookups are lock-free and don't do any syscalls.
+ * Files which are not in the index are passed to another IGetDuration. Thread-safe.
+ */
+class MappedDurationGetter: virtual public IGetDuration
+{
+public:
+
+    struct Stats
+    {
+        uint64_t    hits;
+        uint64_t    misses;
+        uint32_t    size;
+    };
+
+public:
+    MappedDurationGetter();
+    ~MappedDurationGetter();
+
+    bool init(
+            const std::string                   & index_filename,
+            IGetDuration                        * gd,
+            std::string                         * error_msg );
+
+    // interface IGetDuration
+    double get_duration( const std::string & filename ) override;
+
+    // returns false if the file is not in the index
+    bool find( const std::string & filename, double * duration ) const;
+
+    Stats get_stats() const;
+
+private:
+
+    MappedDurationGetter( const MappedDurationGetter & )                = delete;
+    MappedDurationGetter & operator=( const MappedDurationGetter & )    = delete;
+
+    bool validate( std::string * error_msg );
+
+private:
+
+    IGetDuration                * gd_;
+
+    void                        * data_;
+    size_t                      size_;
+
+    const duration_index::Header    * header_;
+    const uint32_t              * buckets_;
+    const duration_index::Entry * entries_;
+    const char                  * names_;
+
+    Counter                     hits_;
+    Counter                     misses_;
+};
+
+} // namespace simple_voip_wrap
+
+#endif  // SIMPLE_VOIP_WRAP__MAPPED_DURATION_GETTER_H
@@ -0,0 +1,206 @@
+/*
+
+Simple VOIP Wrap. Metrics.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13975 $ $Date:: 2020-10-14 #$ $Author: serge $
+
+#include "metrics.h"                    // self
+
+#include <sstream>                      // std::ostringstream
+
+namespace simple_voip_wrap {
+
+// threads get the cells of the counters and histograms round robin
+static uint32_t get_thread_index()
+{
+    static std::atomic<uint32_t> next_index( 0 );
+
+    static thread_local uint32_t index = next_index.fetch_add( 1, std::memory_order_relaxed );
+
+    return index;
+}
+
+Counter::Counter()
+{
+    for( auto & c : cells_ )
+        c.value.store( 0, std::memory_order_relaxed );
+}
+
+uint64_t Counter::get() const
+{
+    uint64_t res = 0;
+
+    for( auto & c : cells_ )
+        res += c.value.load( std::memory_order_relaxed );
+
+    return res;
+}
+
+uint32_t Counter::get_cell_index()
+{
+    return get_thread_index() % NUM_CELLS;
+}
+
+double HistogramSnapshot::get_mean() const
+{
+    return count ? double( sum ) / count : 0;
+}
+
+uint64_t HistogramSnapshot::get_percentile( double percent ) const
+{
+    if( count == 0 )
+        return 0;
+
+    uint64_t rank = static_cast<uint64_t>( count * percent / 100 );
+
+    if( rank >= count )
+        rank = count - 1;
+
+    uint64_t n = 0;
+
+    for( size_t i = 0; i < buckets.size(); ++i )
+    {
+        n += buckets[ i ];
+
+        if( n > rank )
+        {
+            uint64_t upper = ( i == 0 ) ? 0 : ( ( 1ull << i ) - 1 );
+
+            return upper < max ? upper : max;
+        }
+    }
+
+    return max;
+}
+
+Histogram::Histogram()
+{
+    for( auto & c : cells_ )
+    {
+        for( auto & b : c.buckets )
+            b.store( 0, std::memory_order_relaxed );
+
+        c.sum.store( 0, std::memory_order_relaxed );
+        c.max.store( 0, std::memory_order_relaxed );
+    }
+}
+
+void Histogram::add( uint64_t value )
+{
+    uint32_t i = 0;
+
+    // index of the highest bit + 1
+    for( auto v = value; v != 0 && i + 1 < NUM_BUCKETS; v >>= 1 )
+        ++i;
+
+    auto & c = cells_[ get_thread_index() % NUM_CELLS ];
+
+    c.buckets[ i ].fetch_add( 1, std::memory_order_relaxed );
+    c.sum.fetch_add( value, std::memory_order_relaxed );
+
+    auto max = c.max.load( std::memory_order_relaxed );
+
+    while( value > max && c.max.compare_exchange_weak( max, value, std::memory_order_relaxed ) == false )
+    {
+    }
+}
+
+HistogramSnapshot Histogram::get() const
+{
+    HistogramSnapshot res;
+
+    res.count   = 0;
+    res.sum     = 0;
+    res.max     = 0;
+
+    res.buckets.resize( NUM_BUCKETS );
+
+    for( auto & c : cells_ )
+    {
+        res.sum += c.sum.load( std::memory_order_relaxed );
+
+        auto max = c.max.load( std::memory_order_relaxed );
+
+        if( max > res.max )
+            res.max = max;
+
+        for( uint32_t i = 0; i < NUM_BUCKETS; ++i )
+        {
+            auto n = c.buckets[ i ].load( std::memory_order_relaxed );
+
+            res.buckets[ i ]    += n;
+            res.count           += n;
+        }
+    }
+
+    return res;
+}
+
+std::string MetricsSnapshot::to_text() const
+{
+    std::ostringstream os;
+
+    for( auto & c : counters )
+    {
+        os << c.first << " " << c.second << "\n";
+    }
+
+    for( auto & h : histograms )
+    {
+        auto & s = h.second;
+
+        os << h.first << " count " << s.count << " mean " << s.get_mean()
+                << " p50 " << s.get_percentile( 50 ) << " p99 " << s.get_percentile( 99 )
+                << " max " << s.max << "\n";
+    }
+
+    return os.str();
+}
+
+std::string MetricsSnapshot::to_json() const
+{
+    std::ostringstream os;
+
+    os << "{ \"counters\": {";
+
+    for( size_t i = 0; i < counters.size(); ++i )
+    {
+        os << ( i ? ", " : " " ) << "\"" << counters[ i ].first << "\": " << counters[ i ].second;
+    }
+
+    os << " }, \"histograms\": {";
+
+    for( size_t i = 0; i < histograms.size(); ++i )
+    {
+        auto & s = histograms[ i ].second;
+
+        os << ( i ? ", " : " " ) << "\"" << histograms[ i ].first << "\": { \"count\": " << s.count
+                << ", \"mean\": " << s.get_mean()
+                << ", \"p50\": " << s.get_percentile( 50 )
+                << ", \"p99\": " << s.get_percentile( 99 )
+                << ", \"max\": " << s.max << " }";
+    }
+
+    os << " } }";
+
+    return os.str();
+}
+
+} // namespace simple_voip_wrap
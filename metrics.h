@@ -0,0 +1,144 @@
+/*
+
+Simple VOIP Wrap. Metrics.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13975 $ $Date:: 2020-10-14 #$ $Author: serge $
+
+#ifndef SIMPLE_VOIP_WRAP__METRICS_H
+#define SIMPLE_VOIP_WRAP__METRICS_H
+
+#include <atomic>                           // std::atomic
+#include <vector>                           // std::vector
+#include <string>                           // std::string
+#include <utility>                          // std::pair
+#include <cstdint>                          // uint64_t
+
+namespace simple_voip_wrap {
+
+/**
+ * @brief Counter which is cheap to increment from many threads.
+ *
+ * The value is split into cells on separate cache lines, a thread always uses the same cell.
+ * Reading sums up the cells, so it is slower and not atomic as a whole.
+ */
+class Counter
+{
+public:
+    Counter();
+
+    void add( uint64_t value = 1 )
+    {
+        cells_[ get_cell_index() ].value.fetch_add( value, std::memory_order_relaxed );
+    }
+
+    uint64_t get() const;
+
+private:
+
+    Counter( const Counter & )              = delete;
+    Counter & operator=( const Counter & )  = delete;
+
+    enum
+    {
+        NUM_CELLS   = 16,
+        CACHE_LINE  = 64,
+    };
+
+    struct Cell
+    {
+        std::atomic<uint64_t>   value;
+        char                    pad[ CACHE_LINE - sizeof( std::atomic<uint64_t> ) ];
+    };
+
+private:
+
+    static uint32_t get_cell_index();
+
+private:
+
+    Cell    cells_[ NUM_CELLS ];
+};
+
+struct HistogramSnapshot
+{
+    uint64_t                count;
+    uint64_t                sum;
+    uint64_t                max;
+    std::vector<uint64_t>   buckets;        // bucket i counts values in [2^(i-1), 2^i), bucket 0 counts 0
+
+    double get_mean() const;
+
+    // upper bound of the bucket which contains the percentile
+    uint64_t get_percentile( double percent ) const;
+};
+
+/**
+ * @brief Histogram with power of 2 buckets. Thread-safe, lock-free.
+ *
+ * Striped like Counter, a thread always updates the same cell, reading merges the cells.
+ */
+class Histogram
+{
+public:
+    Histogram();
+
+    void add( uint64_t value );
+
+    HistogramSnapshot get() const;
+
+private:
+
+    Histogram( const Histogram & )              = delete;
+    Histogram & operator=( const Histogram & )  = delete;
+
+    enum
+    {
+        NUM_BUCKETS = 48,
+        NUM_CELLS   = 16,
+        CACHE_LINE  = 64,
+        CELL_SIZE   = ( NUM_BUCKETS + 2 ) * sizeof( std::atomic<uint64_t> ),
+    };
+
+    struct Cell
+    {
+        std::atomic<uint64_t>   buckets[ NUM_BUCKETS ];
+        std::atomic<uint64_t>   sum;
+        std::atomic<uint64_t>   max;
+        char                    pad[ CACHE_LINE - CELL_SIZE % CACHE_LINE ];
+    };
+
+private:
+    Cell    cells_[ NUM_CELLS ];
+};
+
+struct MetricsSnapshot
+{
+    std::vector<std::pair<std::string, uint64_t>>           counters;
+    std::vector<std::pair<std::string, HistogramSnapshot>>  histograms;
+
+    // one line per value
+    std::string to_text() const;
+
+    std::string to_json() const;
+};
+
+} // namespace simple_voip_wrap
+
+#endif  // SIMPLE_VOIP_WRAP__METRICS_H
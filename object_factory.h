@@ -19,13 +19,15 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 */
 
-// $Revision: 9747 $ $Date:: 2018-09-21 #$ $Author: serge $
+// $Revision: 13977 $ $Date:: 2020-10-16 #$ $Author: serge $
 
 #ifndef SIMPLE_VOIP_WRAP__OBJECT_FACTORY_H
 #define SIMPLE_VOIP_WRAP__OBJECT_FACTORY_H
 
 #include "objects.h"    // Object...
 
+#include <utility>                          // std::move
+
 #include "simple_voip/object_factory.h"     // init_req_id
 
 namespace simple_voip {
@@ -43,6 +45,31 @@ inline PlayFileRequest *create_PlayFileRequest( uint32_t req_id, uint32_t call_i
     return res;
 }
 
+inline PlayFileRequest *create_PlayFileRequest( uint32_t req_id, uint32_t call_id, std::string && filename )
+{
+    auto * res = new PlayFileRequest;
+
+    init_req_id( res, req_id );
+
+    res->call_id    = call_id;
+    res->filename   = std::move( filename );
+
+    return res;
+}
+
+// filename_id is returned by Wrap::intern_filename() of the Wrap the request is sent to
+inline PlayFileRequest *create_PlayFileRequest( uint32_t req_id, uint32_t call_id, simple_voip_wrap::filename_id_t filename_id )
+{
+    auto * res = new PlayFileRequest;
+
+    init_req_id( res, req_id );
+
+    res->call_id        = call_id;
+    res->filename_id    = filename_id;
+
+    return res;
+}
+
 inline PlayFileStopped *create_PlayFileStopped( uint32_t call_id, uint32_t req_id, uint32_t errorcode, const std::string & error_msg )
 {
     auto * res = new PlayFileStopped;
@@ -69,6 +96,19 @@ inline RecordFileRequest *create_RecordFileRequest( uint32_t req_id, uint32_t ca
     return res;
 }
 
+inline RecordFileRequest *create_RecordFileRequest( uint32_t req_id, uint32_t call_id, std::string && filename, double duration )
+{
+    auto * res = new RecordFileRequest;
+
+    init_req_id( res, req_id );
+
+    res->call_id    = call_id;
+    res->filename   = std::move( filename );
+    res->duration   = duration;
+
+    return res;
+}
+
 inline RecordFileStopped *create_RecordFileStopped( uint32_t call_id, uint32_t req_id, uint32_t errorcode, const std::string & error_msg )
 {
     auto * res = new RecordFileStopped;
@@ -82,6 +122,44 @@ inline RecordFileStopped *create_RecordFileStopped( uint32_t call_id, uint32_t r
     return res;
 }
 
+inline PlayListRequest *create_PlayListRequest( uint32_t req_id, uint32_t call_id, const std::vector<std::string> & filenames )
+{
+    auto * res = new PlayListRequest;
+
+    init_req_id( res, req_id );
+
+    res->call_id    = call_id;
+    res->filenames  = filenames;
+
+    return res;
+}
+
+inline PlayListRequest *create_PlayListRequest( uint32_t req_id, uint32_t call_id, std::vector<std::string> && filenames )
+{
+    auto * res = new PlayListRequest;
+
+    init_req_id( res, req_id );
+
+    res->call_id    = call_id;
+    res->filenames  = std::move( filenames );
+
+    return res;
+}
+
+inline PlayListStopped *create_PlayListStopped( uint32_t call_id, uint32_t req_id, uint32_t index, uint32_t errorcode, const std::string & error_msg )
+{
+    auto * res = new PlayListStopped;
+
+    init_req_id( res, req_id );
+
+    res->call_id    = call_id;
+    res->index      = index;
+    res->errorcode  = errorcode;
+    res->error_msg  = error_msg;
+
+    return res;
+}
+
 } // namespace wrap
 } // namespace simple_voip
 
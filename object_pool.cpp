@@ -0,0 +1,313 @@
+/*
+
+Simple VOIP Wrap. Object Pool.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13970 $ $Date:: 2020-10-12 #$ $Author: serge $
+
+#include "object_pool.h"                // self
+
+#include <algorithm>                    // std::find
+
+#include "utils/mutex_helper.h"         // MUTEX_SCOPE_LOCK
+
+namespace simple_voip_wrap {
+
+static void increment( std::atomic<uint64_t> & value )
+{
+    // the only writer, no atomic read-modify-write is needed
+    value.store( value.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+}
+
+ObjectPool::ThreadCaches::ThreadCaches()
+{
+    for( auto & c : caches )
+    {
+        c.head  = nullptr;
+        c.size  = 0;
+        c.allocations.store( 0, std::memory_order_relaxed );
+        c.releases.store( 0, std::memory_order_relaxed );
+    }
+
+    MUTEX_SCOPE_LOCK( get_registry_mutex() );
+
+    get_thread_caches().push_back( this );
+}
+
+ObjectPool::ThreadCaches::~ThreadCaches()
+{
+    // return the cached objects, otherwise they are lost when the thread exits
+    MUTEX_SCOPE_LOCK( get_registry_mutex() );
+
+    auto ** registry = get_registry();
+
+    for( uint32_t i = 0; i < MAX_POOLS; ++i )
+    {
+        if( registry[ i ] == nullptr )
+            continue;
+
+        auto & c = caches[ i ];
+
+        if( c.size > 0 )
+            registry[ i ]->drain( & c, c.size );
+
+        registry[ i ]->allocations_.fetch_add( c.allocations.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+        registry[ i ]->releases_.fetch_add( c.releases.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+    }
+
+    auto & all = get_thread_caches();
+
+    all.erase( std::find( all.begin(), all.end(), this ) );
+}
+
+ObjectPool::ObjectPool( const std::string & name, size_t object_size ):
+    name_( name ),
+    id_( MAX_POOLS ),
+    free_head_( nullptr ),
+    capacity_( 0 ),
+    allocations_( 0 ),
+    releases_( 0 ),
+    cache_misses_( 0 )
+{
+    // freed objects hold the freelist link, keep the objects aligned as ::operator new does
+    const size_t align = alignof( std::max_align_t );
+
+    if( object_size < sizeof( Node ) )
+        object_size = sizeof( Node );
+
+    object_size_    = ( object_size + align - 1 ) / align * align;
+
+    MUTEX_SCOPE_LOCK( get_registry_mutex() );
+
+    auto ** registry = get_registry();
+
+    for( uint32_t i = 0; i < MAX_POOLS; ++i )
+    {
+        if( registry[ i ] == nullptr )
+        {
+            registry[ i ]   = this;
+            id_             = i;
+            break;
+        }
+    }
+}
+
+void * ObjectPool::allocate()
+{
+    auto * cache = get_cache();
+
+    if( cache == nullptr )
+    {
+        allocations_.fetch_add( 1, std::memory_order_relaxed );
+
+        Cache c;
+
+        c.head  = nullptr;
+        c.size  = 0;
+
+        refill( & c );
+
+        auto * res = c.head;
+
+        c.head = res->next;
+        --c.size;
+
+        drain( & c, c.size );
+
+        return res;
+    }
+
+    increment( cache->allocations );
+
+    if( cache->head == nullptr )
+        refill( cache );
+
+    auto * res = cache->head;
+
+    cache->head = res->next;
+    --cache->size;
+
+    return res;
+}
+
+void ObjectPool::deallocate( void * p )
+{
+    auto * node = static_cast<Node*>( p );
+
+    auto * cache = get_cache();
+
+    if( cache == nullptr )
+    {
+        releases_.fetch_add( 1, std::memory_order_relaxed );
+
+        Cache c;
+
+        c.head      = node;
+        c.size      = 1;
+        node->next  = nullptr;
+
+        drain( & c, 1 );
+        return;
+    }
+
+    increment( cache->releases );
+
+    node->next  = cache->head;
+    cache->head = node;
+    ++cache->size;
+
+    if( cache->size > CACHE_SIZE )
+        drain( cache, BATCH_SIZE );
+}
+
+ObjectPool::Stats ObjectPool::get_stats() const
+{
+    MUTEX_SCOPE_LOCK( get_registry_mutex() );
+
+    return get_stats_locked();
+}
+
+ObjectPool::Stats ObjectPool::get_stats_locked() const
+{
+    // private: registry mutex must be locked, so that the thread caches don't go away
+
+    Stats res;
+
+    res.name            = name_;
+    res.object_size     = static_cast<uint32_t>( object_size_ );
+    res.allocations     = allocations_.load( std::memory_order_relaxed );
+    res.releases        = releases_.load( std::memory_order_relaxed );
+    res.cache_misses    = cache_misses_.load( std::memory_order_relaxed );
+
+    if( id_ < MAX_POOLS )
+    {
+        for( auto * t : get_thread_caches() )
+        {
+            res.allocations += t->caches[ id_ ].allocations.load( std::memory_order_relaxed );
+            res.releases    += t->caches[ id_ ].releases.load( std::memory_order_relaxed );
+        }
+    }
+
+    MUTEX_SCOPE_LOCK( mutex_ );
+
+    res.capacity        = capacity_;
+
+    return res;
+}
+
+std::vector<ObjectPool::Stats> ObjectPool::get_all_stats()
+{
+    std::vector<Stats> res;
+
+    MUTEX_SCOPE_LOCK( get_registry_mutex() );
+
+    auto ** registry = get_registry();
+
+    for( uint32_t i = 0; i < MAX_POOLS; ++i )
+    {
+        if( registry[ i ] )
+            res.push_back( registry[ i ]->get_stats_locked() );
+    }
+
+    return res;
+}
+
+ObjectPool::Cache * ObjectPool::get_cache()
+{
+    if( id_ >= MAX_POOLS )
+        return nullptr;
+
+    static thread_local ThreadCaches caches;
+
+    return & caches.caches[ id_ ];
+}
+
+void ObjectPool::refill( Cache * cache )
+{
+    cache_misses_.fetch_add( 1, std::memory_order_relaxed );
+
+    MUTEX_SCOPE_LOCK( mutex_ );
+
+    if( free_head_ == nullptr )
+    {
+        // allocate a whole batch at once
+        auto * block = static_cast<char*>( ::operator new( object_size_ * BATCH_SIZE ) );
+
+        for( uint32_t i = 0; i < BATCH_SIZE; ++i )
+        {
+            auto * node = reinterpret_cast<Node*>( block + i * object_size_ );
+
+            node->next  = free_head_;
+            free_head_  = node;
+        }
+
+        capacity_   += BATCH_SIZE;
+    }
+
+    for( uint32_t i = 0; i < BATCH_SIZE && free_head_ != nullptr; ++i )
+    {
+        auto * node = free_head_;
+
+        free_head_  = node->next;
+
+        node->next  = cache->head;
+        cache->head = node;
+        ++cache->size;
+    }
+}
+
+void ObjectPool::drain( Cache * cache, uint32_t num )
+{
+    MUTEX_SCOPE_LOCK( mutex_ );
+
+    for( uint32_t i = 0; i < num && cache->head != nullptr; ++i )
+    {
+        auto * node = cache->head;
+
+        cache->head = node->next;
+        --cache->size;
+
+        node->next  = free_head_;
+        free_head_  = node;
+    }
+}
+
+std::mutex & ObjectPool::get_registry_mutex()
+{
+    static std::mutex * mutex = new std::mutex;
+
+    return * mutex;
+}
+
+ObjectPool ** ObjectPool::get_registry()
+{
+    static ObjectPool * registry[ MAX_POOLS ] = { nullptr };
+
+    return registry;
+}
+
+std::vector<ObjectPool::ThreadCaches*> & ObjectPool::get_thread_caches()
+{
+    // never destroyed, threads may exit after the static destructors have run
+    static std::vector<ThreadCaches*> * res = new std::vector<ThreadCaches*>;
+
+    return * res;
+}
+
+} // namespace simple_voip_wrap
@@ -0,0 +1,174 @@
+/*
+
+Simple VOIP Wrap. Object Pool.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13970 $ $Date:: 2020-10-12 #$ $Author: serge $
+
+#ifndef SIMPLE_VOIP_WRAP__OBJECT_POOL_H
+#define SIMPLE_VOIP_WRAP__OBJECT_POOL_H
+
+#include <mutex>                            // std::mutex
+#include <atomic>                           // std::atomic
+#include <vector>                           // std::vector
+#include <string>                           // std::string
+#include <cstdint>                          // uint32_t
+#include <cstddef>                          // size_t
+#include <new>                              // operator new
+#include <typeinfo>                         // typeid
+
+namespace simple_voip_wrap {
+
+/**
+ * @brief Freelist of fixed size objects with per-thread caches.
+ *
+ * Objects are taken from the cache of the calling thread, the caches exchange objects
+ * with the shared freelist in batches, so the mutex is rarely locked.
+ * Memory is never returned to the heap. Pools live until the process exits.
+ */
+class ObjectPool
+{
+public:
+
+    struct Stats
+    {
+        std::string name;
+        uint32_t    object_size;
+        uint64_t    allocations;
+        uint64_t    releases;
+        uint64_t    cache_misses;   // allocations which had to lock the shared freelist
+        uint64_t    capacity;       // objects allocated from the heap
+    };
+
+public:
+    ObjectPool( const std::string & name, size_t object_size );
+
+    void * allocate();
+    void deallocate( void * p );
+
+    Stats get_stats() const;
+
+    static std::vector<Stats> get_all_stats();
+
+private:
+
+    ObjectPool( const ObjectPool & )                = delete;
+    ObjectPool & operator=( const ObjectPool & )    = delete;
+
+    struct Node
+    {
+        Node        * next;
+    };
+
+    struct Cache
+    {
+        Node        * head;
+        uint32_t    size;
+
+        // written only by the owning thread, summed up by get_stats()
+        std::atomic<uint64_t>   allocations;
+        std::atomic<uint64_t>   releases;
+    };
+
+    enum
+    {
+        MAX_POOLS   = 16,
+        BATCH_SIZE  = 32,
+        CACHE_SIZE  = BATCH_SIZE * 2,
+    };
+
+    struct ThreadCaches
+    {
+        ThreadCaches();
+        ~ThreadCaches();
+
+        Cache       caches[ MAX_POOLS ];
+    };
+
+private:
+
+    Cache * get_cache();
+
+    Stats get_stats_locked() const;
+
+    void refill( Cache * cache );
+    void drain( Cache * cache, uint32_t num );
+
+    static std::mutex & get_registry_mutex();
+    static ObjectPool ** get_registry();
+    static std::vector<ThreadCaches*> & get_thread_caches();
+
+private:
+
+    std::string                 name_;
+    size_t                      object_size_;
+    uint32_t                    id_;            // MAX_POOLS if the pool has no thread caches
+
+    mutable std::mutex          mutex_;
+    Node                        * free_head_;
+    uint64_t                    capacity_;
+
+    std::atomic<uint64_t>       allocations_;   // of exited threads and of a pool without thread caches
+    std::atomic<uint64_t>       releases_;
+    std::atomic<uint64_t>       cache_misses_;
+};
+
+/**
+ * @brief Base class which makes new/delete of T go through an ObjectPool.
+ *
+ * Derived classes of other sizes fall back to the global operators.
+ * Requires a virtual destructor in the hierarchy if objects are deleted through a base pointer.
+ */
+template <class T>
+struct Pooled
+{
+    static void * operator new( size_t size )
+    {
+        if( size != sizeof( T ) )
+            return ::operator new( size );
+
+        return get_pool().allocate();
+    }
+
+    static void operator delete( void * p, size_t size )
+    {
+        if( p == nullptr )
+            return;
+
+        if( size != sizeof( T ) )
+        {
+            ::operator delete( p );
+            return;
+        }
+
+        get_pool().deallocate( p );
+    }
+
+    static ObjectPool & get_pool()
+    {
+        // never destroyed, objects may be released by other threads during exit
+        static ObjectPool * pool = new ObjectPool( typeid( T ).name(), sizeof( T ) );
+
+        return * pool;
+    }
+};
+
+} // namespace simple_voip_wrap
+
+#endif  // SIMPLE_VOIP_WRAP__OBJECT_POOL_H
@@ -19,13 +19,18 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 */
 
-// $Revision: 9747 $ $Date:: 2018-09-21 #$ $Author: serge $
+// $Revision: 13977 $ $Date:: 2020-10-16 #$ $Author: serge $
 
 #ifndef SIMPLE_VOIP_WRAP__OBJECTS_H
 #define SIMPLE_VOIP_WRAP__OBJECTS_H
 
+#include <vector>                   // std::vector
+
 #include "simple_voip/objects.h"    // Object...
 
+#include "object_pool.h"            // Pooled
+#include "filename_table.h"         // filename_id_t
+
 namespace simple_voip {
 
 namespace wrap {
@@ -33,15 +38,28 @@ namespace wrap {
 enum ErrorCodes
 {
     SCHEDULER_ERROR = 1,
+    TOO_MANY_REQUESTS = 2,
+    CALL_ENDED = 3,
+    INVALID_FILENAME = 4,
+    QUEUE_FULL = 5,
+    REQUEST_TIMEOUT = 6,
+    DURATION_UNAVAILABLE = 7,
 };
 
 // ******************* IN-CALL REQUESTS *******************
 
-struct PlayFileRequest: public simple_voip::PlayFileRequest
+// if filename_id is set, filename may be empty, see simple_voip_wrap::Wrap::intern_filename()
+struct PlayFileRequest: public simple_voip::PlayFileRequest, public simple_voip_wrap::Pooled<PlayFileRequest>
 {
+    PlayFileRequest():
+        filename_id( 0 )
+    {
+    }
+
+    simple_voip_wrap::filename_id_t filename_id;
 };
 
-struct PlayFileStopped: public CallbackObject
+struct PlayFileStopped: public CallbackObject, public simple_voip_wrap::Pooled<PlayFileStopped>
 {
     uint32_t    call_id;
     uint32_t    req_id;
@@ -49,16 +67,32 @@ struct PlayFileStopped: public CallbackObject
     std::string error_msg;
 };
 
-struct RecordFileRequest: public simple_voip::RecordFileRequest
+struct RecordFileRequest: public simple_voip::RecordFileRequest, public simple_voip_wrap::Pooled<RecordFileRequest>
 {
     double  duration;
 };
 
 
-struct RecordFileStopped: public CallbackObject
+struct RecordFileStopped: public CallbackObject, public simple_voip_wrap::Pooled<RecordFileStopped>
+{
+    uint32_t    call_id;
+    uint32_t    req_id;
+    uint32_t    errorcode;
+    std::string error_msg;
+};
+
+// files are played one after another, PlayListStopped is sent when the last one has ended
+struct PlayListRequest: public simple_voip::Request, public simple_voip_wrap::Pooled<PlayListRequest>
+{
+    uint32_t                    call_id;
+    std::vector<std::string>    filenames;
+};
+
+struct PlayListStopped: public CallbackObject, public simple_voip_wrap::Pooled<PlayListStopped>
 {
     uint32_t    call_id;
     uint32_t    req_id;
+    uint32_t    index;      // the file which was played when the list stopped, number of files if all have been played
     uint32_t    errorcode;
     std::string error_msg;
 };
@@ -0,0 +1,94 @@
+/*
+
+Simple VOIP Wrap. Outbox.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13965 $ $Date:: 2020-10-09 #$ $Author: serge $
+
+#include "outbox.h"                     // self
+
+#include "utils/utils_assert.h"         // ASSERT
+
+namespace simple_voip_wrap {
+
+Outbox::Outbox():
+    size_( 0 )
+{
+}
+
+Outbox::~Outbox()
+{
+    // messages must not be lost
+    ASSERT( is_empty() );
+}
+
+void Outbox::add( const simple_voip::ForwardObject * obj )
+{
+    add( Entry { obj, nullptr } );
+}
+
+void Outbox::add( const simple_voip::CallbackObject * obj )
+{
+    add( Entry { nullptr, obj } );
+}
+
+void Outbox::reserve( size_t size )
+{
+    if( size > INLINE_SIZE )
+        overflow_.reserve( size - INLINE_SIZE );
+}
+
+bool Outbox::is_empty() const
+{
+    return size_ == 0;
+}
+
+size_t Outbox::size() const
+{
+    return size_;
+}
+
+void Outbox::add( const Entry & e )
+{
+    if( size_ < INLINE_SIZE )
+        inline_[ size_ ] = e;
+    else
+        overflow_.push_back( e );
+
+    ++size_;
+}
+
+void Outbox::flush( simple_voip::ISimpleVoip * voips, simple_voip::ISimpleVoipCallback * callback )
+{
+    for( size_t i = 0; i < size_; ++i )
+    {
+        auto & e = ( i < INLINE_SIZE ) ? inline_[ i ] : overflow_[ i - INLINE_SIZE ];
+
+        if( e.forward )
+            voips->consume( e.forward );
+        else
+            callback->consume( e.callback );
+    }
+
+    size_ = 0;
+
+    overflow_.clear();
+}
+
+} // namespace simple_voip_wrap
@@ -0,0 +1,88 @@
+/*
+
+Simple VOIP Wrap. Outbox.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13965 $ $Date:: 2020-10-09 #$ $Author: serge $
+
+#ifndef SIMPLE_VOIP_WRAP__OUTBOX_H
+#define SIMPLE_VOIP_WRAP__OUTBOX_H
+
+#include <vector>                           // std::vector
+#include <cstddef>                          // size_t
+
+#include "simple_voip/i_simple_voip.h"      // simple_voip::ISimpleVoip
+#include "simple_voip/i_simple_voip_callback.h" // ISimpleVoipCallback
+
+namespace simple_voip_wrap {
+
+/**
+ * @brief Collects outgoing messages while the state is locked.
+ *
+ * Messages are delivered by flush() in the order they were added, after the lock is released.
+ * The first few messages are stored without allocation.
+ */
+class Outbox
+{
+public:
+    Outbox();
+    ~Outbox();
+
+    void add( const simple_voip::ForwardObject * obj );
+    void add( const simple_voip::CallbackObject * obj );
+
+    // preallocates space for a batch of messages
+    void reserve( size_t size );
+
+    bool is_empty() const;
+    size_t size() const;
+
+    void flush( simple_voip::ISimpleVoip * voips, simple_voip::ISimpleVoipCallback * callback );
+
+private:
+
+    Outbox( const Outbox & )                = delete;
+    Outbox & operator=( const Outbox & )    = delete;
+
+    struct Entry
+    {
+        const simple_voip::ForwardObject    * forward;
+        const simple_voip::CallbackObject   * callback;
+    };
+
+    enum
+    {
+        INLINE_SIZE = 4
+    };
+
+private:
+
+    void add( const Entry & e );
+
+private:
+
+    Entry               inline_[ INLINE_SIZE ];
+    size_t              size_;
+
+    std::vector<Entry>  overflow_;
+};
+
+} // namespace simple_voip_wrap
+
+#endif  // SIMPLE_VOIP_WRAP__OUTBOX_H
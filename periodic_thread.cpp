@@ -0,0 +1,109 @@
+/*
+
+Simple VOIP Wrap. Periodic Thread.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13967 $ $Date:: 2020-10-10 #$ $Author: serge $
+
+#include "periodic_thread.h"            // self
+
+#include "utils/mutex_helper.h"         // MUTEX_SCOPE_LOCK
+
+namespace simple_voip_wrap {
+
+PeriodicThread::PeriodicThread():
+    is_running_( false ),
+    period_( 0 )
+{
+}
+
+PeriodicThread::~PeriodicThread()
+{
+    shutdown();
+}
+
+bool PeriodicThread::init(
+        Duration                            period,
+        const Func                          & func,
+        std::string                         * error_msg )
+{
+    if( period.count() <= 0 )
+    {
+        * error_msg = "period must be positive";
+        return false;
+    }
+
+    MUTEX_SCOPE_LOCK( mutex_ );
+
+    if( is_running_ || thread_.joinable() )
+    {
+        * error_msg = "already initialized";
+        return false;
+    }
+
+    period_     = period;
+    func_       = func;
+    is_running_ = true;
+
+    thread_     = std::thread( & PeriodicThread::thread_func, this );
+
+    return true;
+}
+
+void PeriodicThread::shutdown()
+{
+    {
+        MUTEX_SCOPE_LOCK( mutex_ );
+
+        is_running_ = false;
+    }
+
+    cond_.notify_all();
+
+    if( thread_.joinable() )
+        thread_.join();
+}
+
+void PeriodicThread::thread_func()
+{
+    auto next = std::chrono::steady_clock::now() + period_;
+
+    while( true )
+    {
+        {
+            std::unique_lock<std::mutex> lock( mutex_ );
+
+            cond_.wait_until( lock, next, [this]{ return is_running_ == false; } );
+
+            if( is_running_ == false )
+                return;
+        }
+
+        func_();
+
+        next += period_;
+
+        auto now = std::chrono::steady_clock::now();
+
+        if( next < now )
+            next = now + period_;
+    }
+}
+
+} // namespace simple_voip_wrap
@@ -0,0 +1,76 @@
+/*
+
+Simple VOIP Wrap. Periodic Thread.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13967 $ $Date:: 2020-10-10 #$ $Author: serge $
+
+#ifndef SIMPLE_VOIP_WRAP__PERIODIC_THREAD_H
+#define SIMPLE_VOIP_WRAP__PERIODIC_THREAD_H
+
+#include <mutex>                            // std::mutex
+#include <condition_variable>               // std::condition_variable
+#include <thread>                           // std::thread
+#include <functional>                       // std::function
+#include <chrono>                           // std::chrono
+#include <string>                           // std::string
+
+namespace simple_voip_wrap {
+
+/**
+ * @brief Calls a function from its own thread with a fixed period.
+ *
+ * If the function runs longer than the period, the missed calls are not repeated.
+ */
+class PeriodicThread
+{
+public:
+    typedef std::function<void()>       Func;
+    typedef std::chrono::microseconds   Duration;
+
+public:
+    PeriodicThread();
+    ~PeriodicThread();
+
+    bool init(
+            Duration                            period,
+            const Func                          & func,
+            std::string                         * error_msg );
+
+    void shutdown();
+
+private:
+
+    void thread_func();
+
+private:
+    mutable std::mutex          mutex_;
+    std::condition_variable     cond_;
+
+    bool                        is_running_;
+
+    Duration                    period_;
+    Func                        func_;
+
+    std::thread                 thread_;
+};
+
+} // namespace simple_voip_wrap
+
+#endif  // SIMPLE_VOIP_WRAP__PERIODIC_THREAD_H
@@ -0,0 +1,338 @@
+/*
+
+Multi-threaded scalability benchmark of Wrap.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13973 $ $Date:: 2020-10-13 #$ $Author: serge $
+
+#include <iostream>         // cout
+#include <fstream>          // std::ofstream
+#include <sstream>          // std::ostringstream
+#include <atomic>           // std::atomic
+#include <chrono>           // std::chrono
+#include <thread>           // std::thread
+#include <vector>           // std::vector
+#include <algorithm>        // std::sort
+#include <typeinfo>         // typeid
+
+#include "simple_voip/objects.h"
+#include "simple_voip/object_factory.h"         // init_req_id
+#include "simple_voip/i_simple_voip.h"          // simple_voip::ISimpleVoip
+#include "simple_voip/i_simple_voip_callback.h" // simple_voip::ISimpleVoipCallback
+#include "utils/dummy_logger.h"                 // dummy_logger::set_log_level
+#include "utils/request_id_gen.h"               // RequestIdGen
+#include "scheduler/scheduler.h"                // Scheduler
+
+#include "simple_voip_wrap/wrap.h"              // simple_voip_wrap::Wrap
+#include "simple_voip_wrap/object_factory.h"    // simple_voip::wrap::create_PlayFileRequest
+
+namespace scalability {
+
+template <class T>
+T * create_response( uint32_t req_id )
+{
+    auto * res = new T;
+
+    simple_voip::init_req_id( res, req_id );
+
+    return res;
+}
+
+// engine, answers stop requests at once from the thread of the caller, i.e. the timer thread
+class Voip: virtual public simple_voip::ISimpleVoip
+{
+public:
+    Voip():
+        wrap_( nullptr )
+    {
+    }
+
+    void init( simple_voip::ISimpleVoipCallback * wrap )
+    {
+        wrap_   = wrap;
+    }
+
+    void consume( const simple_voip::ForwardObject * req ) override
+    {
+        if( typeid( * req ) == typeid( simple_voip::PlayFileStopRequest ) )
+        {
+            auto req_id = static_cast<const simple_voip::PlayFileStopRequest*>( req )->req_id;
+
+            delete req;
+
+            wrap_->consume( create_response<simple_voip::PlayFileStopResponse>( req_id ) );
+            return;
+        }
+
+        delete req;
+    }
+
+private:
+    simple_voip::ISimpleVoipCallback    * wrap_;
+};
+
+// application
+class Callback: virtual public simple_voip::ISimpleVoipCallback
+{
+public:
+    Callback():
+        num_stopped( 0 )
+    {
+    }
+
+    void consume( const simple_voip::CallbackObject * obj ) override
+    {
+        if( typeid( * obj ) == typeid( simple_voip::wrap::PlayFileStopped ) )
+            num_stopped.fetch_add( 1, std::memory_order_relaxed );
+
+        delete obj;
+    }
+
+    std::atomic<uint64_t>   num_stopped;
+};
+
+class GetDuration: virtual public simple_voip_wrap::IGetDuration
+{
+public:
+    double get_duration( const std::string & filename ) override
+    {
+        // short plays, so that the timer thread keeps generating stops
+        return 0.005;
+    }
+};
+
+struct Result
+{
+    uint32_t    num_threads;
+    uint64_t    num_ops;
+    double      ops_per_sec;
+    uint64_t    p50_ns;
+    uint64_t    p99_ns;
+    uint64_t    p999_ns;
+
+    simple_voip_wrap::LockStats lock_stats;
+};
+
+/**
+ * @brief Each thread plays the application and the engine for its own calls: it sends PlayFileRequest
+ * and answers it with PlayFileResponse. The timing wheel thread sends the stops concurrently.
+ * Latency is the duration of one consume() call.
+ */
+Result run( uint32_t num_threads, uint64_t ops_per_thread, uint32_t num_shards )
+{
+    Voip                        voip;
+    Callback                    callback;
+    scheduler::Scheduler        sched( scheduler::Duration( std::chrono::milliseconds( 1 ) ) );
+    utils::RequestIdGen         req_id_gen;
+    GetDuration                 gd;
+    simple_voip_wrap::Wrap      wrap;
+
+    simple_voip_wrap::Config config;
+
+    config.num_shards           = num_shards;
+    config.max_pending_requests = 65536;
+    config.timer_tick_ms        = 1;
+    config.lock_profiling       = true;
+
+    std::string error_msg;
+
+    if( wrap.init( 0, config, & voip, & callback, & sched, & req_id_gen, & gd, & error_msg ) == false )
+    {
+        std::cerr << "cannot initialize Wrap: " << error_msg << std::endl;
+        exit( EXIT_FAILURE );
+    }
+
+    voip.init( & wrap );
+
+    std::vector<std::vector<uint32_t>>  latencies( num_threads );
+    std::vector<std::thread>            threads;
+
+    std::atomic<bool>   is_started( false );
+
+    for( uint32_t t = 0; t < num_threads; ++t )
+    {
+        latencies[ t ].reserve( ops_per_thread * 2 );
+
+        threads.push_back( std::thread( [&, t]()
+        {
+            auto & lat = latencies[ t ];
+
+            while( is_started.load() == false )
+                std::this_thread::yield();
+
+            for( uint64_t i = 0; i < ops_per_thread; ++i )
+            {
+                // many distinct calls per thread
+                uint32_t call_id    = t * 1000000 + static_cast<uint32_t>( i % 10000 );
+                auto req_id         = req_id_gen.get_next_request_id();
+
+                auto * req  = simple_voip::wrap::create_PlayFileRequest( req_id, call_id, "play.wav" );
+                auto * resp = create_response<simple_voip::PlayFileResponse>( req_id );
+
+                auto t1 = std::chrono::steady_clock::now();
+
+                wrap.consume( req );
+
+                auto t2 = std::chrono::steady_clock::now();
+
+                wrap.consume( resp );
+
+                auto t3 = std::chrono::steady_clock::now();
+
+                lat.push_back( std::chrono::duration_cast<std::chrono::nanoseconds>( t2 - t1 ).count() );
+                lat.push_back( std::chrono::duration_cast<std::chrono::nanoseconds>( t3 - t2 ).count() );
+            }
+        } ) );
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    is_started  = true;
+
+    for( auto & t : threads )
+        t.join();
+
+    auto end = std::chrono::steady_clock::now();
+
+    // let the remaining plays stop
+    std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+
+    Result res;
+
+    res.lock_stats  = wrap.get_lock_stats();
+
+    wrap.shutdown();
+
+    std::vector<uint32_t> all;
+
+    for( auto & l : latencies )
+        all.insert( all.end(), l.begin(), l.end() );
+
+    std::sort( all.begin(), all.end() );
+
+    auto secs = std::chrono::duration<double>( end - start ).count();
+
+    res.num_threads = num_threads;
+    res.num_ops     = ops_per_thread * num_threads;
+    res.ops_per_sec = res.num_ops / secs;
+    res.p50_ns      = all[ all.size() * 50 / 100 ];
+    res.p99_ns      = all[ all.size() * 99 / 100 ];
+    res.p999_ns     = all[ all.size() * 999 / 1000 ];
+
+    return res;
+}
+
+std::string to_json( const std::vector<Result> & results, uint32_t num_shards )
+{
+    std::ostringstream os;
+
+    os << "{\n  \"num_shards\": " << num_shards << ",\n  \"results\": [\n";
+
+    for( size_t i = 0; i < results.size(); ++i )
+    {
+        auto & r = results[ i ];
+        auto & l = r.lock_stats;
+
+        auto num_locks = l.num_locks ? l.num_locks : 1;
+
+        os << "    { \"threads\": " << r.num_threads
+                << ", \"ops\": " << r.num_ops
+                << ", \"ops_per_sec\": " << uint64_t( r.ops_per_sec )
+                << ", \"p50_ns\": " << r.p50_ns
+                << ", \"p99_ns\": " << r.p99_ns
+                << ", \"p999_ns\": " << r.p999_ns
+                << ", \"locks\": " << l.num_locks
+                << ", \"lock_wait_ns_avg\": " << l.wait_ns / num_locks
+                << ", \"lock_wait_ns_max\": " << l.max_wait_ns
+                << ", \"lock_hold_ns_avg\": " << l.hold_ns / num_locks
+                << " }" << ( i + 1 < results.size() ? "," : "" ) << "\n";
+    }
+
+    os << "  ]\n}\n";
+
+    return os.str();
+}
+
+} // namespace scalability
+
+int main( int argc, char **argv )
+{
+    uint32_t max_threads    = std::thread::hardware_concurrency();
+    uint64_t ops_per_thread = 100000;
+    uint32_t num_shards     = 16;
+
+    std::string output_file;
+
+    if( argc > 1 )
+        max_threads = std::stoul( argv[1] );
+
+    if( argc > 2 )
+        ops_per_thread = std::stoull( argv[2] );
+
+    if( argc > 3 )
+        num_shards = std::stoul( argv[3] );
+
+    if( argc > 4 )
+        output_file = argv[4];
+
+    if( max_threads == 0 )
+        max_threads = 1;
+
+    if( ops_per_thread == 0 || num_shards == 0 )
+    {
+        std::cerr << "usage: scalability [max_threads] [ops_per_thread] [num_shards] [output.json]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    dummy_logger::set_log_level( log_levels_log4j::FATAL );
+
+    std::vector<scalability::Result> results;
+
+    // powers of two below the maximum, the last point is always the maximum
+    std::vector<uint32_t> thread_counts;
+
+    for( uint32_t n = 1; n < max_threads; n *= 2 )
+        thread_counts.push_back( n );
+
+    thread_counts.push_back( max_threads );
+
+    for( auto n : thread_counts )
+        results.push_back( scalability::run( n, ops_per_thread, num_shards ) );
+
+    auto json = scalability::to_json( results, num_shards );
+
+    if( output_file.empty() )
+    {
+        std::cout << json;
+    }
+    else
+    {
+        std::ofstream os( output_file );
+
+        os << json;
+
+        if( os.fail() )
+        {
+            std::cerr << "cannot write " << output_file << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    return 0;
+}
@@ -19,52 +19,110 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 */
 
-// $Revision: 9747 $ $Date:: 2018-09-21 #$ $Author: serge $
+// $Revision: 13977 $ $Date:: 2020-10-16 #$ $Author: serge $
 
 #include "str_helper.h"                 // self
 
 #include <typeinfo>
+#include <cstdio>                       // snprintf
 
 #include "simple_voip/str_helper.h"     // simple_voip::StrHelper::write()
 
+#include "type_dispatcher.h"            // TypeDispatcher
+
 namespace simple_voip_wrap {
 
+// objects of the wrap, which are written field by field, used by write() and format(),
+// followed by the objects of simple_voip which are written by simple_voip::StrHelper and formatted here
+typedef TypeDispatcher<simple_voip::IObject,
+        simple_voip::wrap::PlayFileRequest,
+        simple_voip::wrap::PlayFileStopped,
+        simple_voip::wrap::RecordFileRequest,
+        simple_voip::wrap::RecordFileStopped,
+        simple_voip::wrap::PlayListRequest,
+        simple_voip::wrap::PlayListStopped,
+        simple_voip::PlayFileRequest,
+        simple_voip::PlayFileStopRequest,
+        simple_voip::RecordFileRequest,
+        simple_voip::RecordFileStopRequest,
+        simple_voip::DropRequest,
+        simple_voip::PlayFileResponse,
+        simple_voip::PlayFileStopResponse,
+        simple_voip::RecordFileResponse,
+        simple_voip::RecordFileStopResponse,
+        simple_voip::DropResponse,
+        simple_voip::ErrorResponse,
+        simple_voip::RejectResponse,
+        simple_voip::ConnectionLost>            Dispatcher;
+
 std::ostream & StrHelper::write( std::ostream & os, const simple_voip::IObject & o )
 {
-    if( typeid( o ) == typeid( simple_voip::wrap::PlayFileRequest ) )
+    switch( Dispatcher::get_tag( o ) )
+    {
+    case Dispatcher::tag<simple_voip::wrap::PlayFileRequest>():
     {
         os << typeid( o ).name();
 
-        auto & m = dynamic_cast<const simple_voip::wrap::PlayFileRequest&>( o );
+        auto & m = static_cast<const simple_voip::wrap::PlayFileRequest&>( o );
 
         os << " " << m.req_id << " " << m.call_id << " " << m.filename;
     }
-    else if( typeid( o ) == typeid( simple_voip::wrap::PlayFileStopped ) )
+    break;
+
+    case Dispatcher::tag<simple_voip::wrap::PlayFileStopped>():
     {
         os << typeid( o ).name();
 
-        auto & m = dynamic_cast<const simple_voip::wrap::PlayFileStopped&>( o );
+        auto & m = static_cast<const simple_voip::wrap::PlayFileStopped&>( o );
 
         os << " " << m.req_id << " " << m.call_id << " " << m.errorcode << " " << m.error_msg;
     }
-    else if( typeid( o ) == typeid( simple_voip::wrap::RecordFileRequest ) )
+    break;
+
+    case Dispatcher::tag<simple_voip::wrap::RecordFileRequest>():
     {
         os << typeid( o ).name();
 
-        auto & m = dynamic_cast<const simple_voip::wrap::RecordFileRequest&>( o );
+        auto & m = static_cast<const simple_voip::wrap::RecordFileRequest&>( o );
 
         os << " " << m.req_id << " " << m.call_id << " " << m.filename;
     }
-    else if( typeid( o ) == typeid( simple_voip::wrap::RecordFileStopped ) )
+    break;
+
+    case Dispatcher::tag<simple_voip::wrap::RecordFileStopped>():
     {
         os << typeid( o ).name();
 
-        auto & m = dynamic_cast<const simple_voip::wrap::RecordFileStopped&>( o );
+        auto & m = static_cast<const simple_voip::wrap::RecordFileStopped&>( o );
 
         os << " " << m.req_id << " " << m.call_id << " " << m.errorcode << " " << m.error_msg;
     }
-    else
+    break;
+
+    case Dispatcher::tag<simple_voip::wrap::PlayListRequest>():
     {
+        os << typeid( o ).name();
+
+        auto & m = static_cast<const simple_voip::wrap::PlayListRequest&>( o );
+
+        os << " " << m.req_id << " " << m.call_id;
+
+        for( auto & f : m.filenames )
+            os << " " << f;
+    }
+    break;
+
+    case Dispatcher::tag<simple_voip::wrap::PlayListStopped>():
+    {
+        os << typeid( o ).name();
+
+        auto & m = static_cast<const simple_voip::wrap::PlayListStopped&>( o );
+
+        os << " " << m.req_id << " " << m.call_id << " " << m.index << " " << m.errorcode << " " << m.error_msg;
+    }
+    break;
+
+    default:
         return simple_voip::StrHelper::write( os, o );
     }
 
@@ -80,4 +138,154 @@ const std::string StrHelper::to_string( const simple_voip::IObject & o )
     return os.str();
 }
 
+const char * StrHelper::format( char * buf, size_t size, const simple_voip::IObject & o )
+{
+    if( size == 0 )
+        return buf;
+
+    auto name = typeid( o ).name();
+
+    switch( Dispatcher::get_tag( o ) )
+    {
+    case Dispatcher::tag<simple_voip::wrap::PlayFileRequest>():
+    {
+        auto & m = static_cast<const simple_voip::wrap::PlayFileRequest&>( o );
+
+        snprintf( buf, size, "%s %u %u %s", name, m.req_id, m.call_id, m.filename.c_str() );
+    }
+    break;
+
+    case Dispatcher::tag<simple_voip::wrap::PlayFileStopped>():
+    {
+        auto & m = static_cast<const simple_voip::wrap::PlayFileStopped&>( o );
+
+        snprintf( buf, size, "%s %u %u %u %s", name, m.req_id, m.call_id, m.errorcode, m.error_msg.c_str() );
+    }
+    break;
+
+    case Dispatcher::tag<simple_voip::wrap::RecordFileRequest>():
+    {
+        auto & m = static_cast<const simple_voip::wrap::RecordFileRequest&>( o );
+
+        snprintf( buf, size, "%s %u %u %s", name, m.req_id, m.call_id, m.filename.c_str() );
+    }
+    break;
+
+    case Dispatcher::tag<simple_voip::wrap::RecordFileStopped>():
+    {
+        auto & m = static_cast<const simple_voip::wrap::RecordFileStopped&>( o );
+
+        snprintf( buf, size, "%s %u %u %u %s", name, m.req_id, m.call_id, m.errorcode, m.error_msg.c_str() );
+    }
+    break;
+
+    case Dispatcher::tag<simple_voip::wrap::PlayListRequest>():
+    {
+        auto & m = static_cast<const simple_voip::wrap::PlayListRequest&>( o );
+
+        // file names are omitted, the list may be long
+        snprintf( buf, size, "%s %u %u %u files", name, m.req_id, m.call_id, (unsigned)m.filenames.size() );
+    }
+    break;
+
+    case Dispatcher::tag<simple_voip::wrap::PlayListStopped>():
+    {
+        auto & m = static_cast<const simple_voip::wrap::PlayListStopped&>( o );
+
+        snprintf( buf, size, "%s %u %u %u %u %s", name, m.req_id, m.call_id, m.index, m.errorcode, m.error_msg.c_str() );
+    }
+    break;
+
+    case Dispatcher::tag<simple_voip::PlayFileRequest>():
+    {
+        auto & m = static_cast<const simple_voip::PlayFileRequest&>( o );
+
+        snprintf( buf, size, "%s %u %u %s", name, m.req_id, m.call_id, m.filename.c_str() );
+    }
+    break;
+
+    case Dispatcher::tag<simple_voip::RecordFileRequest>():
+    {
+        auto & m = static_cast<const simple_voip::RecordFileRequest&>( o );
+
+        snprintf( buf, size, "%s %u %u %s", name, m.req_id, m.call_id, m.filename.c_str() );
+    }
+    break;
+
+    case Dispatcher::tag<simple_voip::PlayFileStopRequest>():
+    {
+        auto & m = static_cast<const simple_voip::PlayFileStopRequest&>( o );
+
+        snprintf( buf, size, "%s %u %u", name, m.req_id, m.call_id );
+    }
+    break;
+
+    case Dispatcher::tag<simple_voip::RecordFileStopRequest>():
+    {
+        auto & m = static_cast<const simple_voip::RecordFileStopRequest&>( o );
+
+        snprintf( buf, size, "%s %u %u", name, m.req_id, m.call_id );
+    }
+    break;
+
+    case Dispatcher::tag<simple_voip::DropRequest>():
+    {
+        auto & m = static_cast<const simple_voip::DropRequest&>( o );
+
+        snprintf( buf, size, "%s %u %u", name, m.req_id, m.call_id );
+    }
+    break;
+
+    case Dispatcher::tag<simple_voip::PlayFileResponse>():
+    case Dispatcher::tag<simple_voip::PlayFileStopResponse>():
+    case Dispatcher::tag<simple_voip::RecordFileResponse>():
+    case Dispatcher::tag<simple_voip::RecordFileStopResponse>():
+    case Dispatcher::tag<simple_voip::DropResponse>():
+    {
+        auto & m = static_cast<const simple_voip::ResponseObject&>( o );
+
+        snprintf( buf, size, "%s %u", name, m.req_id );
+    }
+    break;
+
+    case Dispatcher::tag<simple_voip::ErrorResponse>():
+    {
+        auto & m = static_cast<const simple_voip::ErrorResponse&>( o );
+
+        snprintf( buf, size, "%s %u %u %s", name, m.req_id, m.errorcode, m.descr.c_str() );
+    }
+    break;
+
+    case Dispatcher::tag<simple_voip::RejectResponse>():
+    {
+        auto & m = static_cast<const simple_voip::RejectResponse&>( o );
+
+        snprintf( buf, size, "%s %u %u %s", name, m.req_id, m.errorcode, m.descr.c_str() );
+    }
+    break;
+
+    case Dispatcher::tag<simple_voip::ConnectionLost>():
+    {
+        auto & m = static_cast<const simple_voip::ConnectionLost&>( o );
+
+        snprintf( buf, size, "%s %u", name, m.call_id );
+    }
+    break;
+
+    default:
+        // nothing of the wrap or its engine, the fields are unknown
+        snprintf( buf, size, "%s", name );
+        break;
+    }
+
+    return buf;
+}
+
+const char * StrHelper::to_cstr( const simple_voip::IObject & o )
+{
+    static thread_local char buf[ 256 ];
+
+    return format( buf, sizeof( buf ), o );
+}
+
 } // namespace simple_voip_wrap
@@ -25,6 +25,7 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #define SIMPLE_VOIP_WRAP__STR_HELPER_H
 
 #include <sstream>          // std::ostringstream
+#include <cstddef>          // size_t
 
 #include "objects.h"        // PlayFileRequest
 
@@ -35,6 +36,10 @@ class StrHelper
 public:
     static std::ostream & write( std::ostream & os, const simple_voip::IObject & l );
     static const std::string to_string( const simple_voip::IObject & o );
+
+    // allocation-free versions for tracing, the output is truncated to the buffer size
+    static const char * format( char * buf, size_t size, const simple_voip::IObject & o );
+    static const char * to_cstr( const simple_voip::IObject & o );      // thread-local buffer, valid until the next call
 };
 
 } // namespace simple_voip_wrap
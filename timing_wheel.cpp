@@ -0,0 +1,244 @@
+/*
+
+Simple VOIP Wrap. Hierarchical Timing Wheel.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13967 $ $Date:: 2020-10-10 #$ $Author: serge $
+
+#include "timing_wheel.h"               // self
+
+namespace simple_voip_wrap {
+
+const uint32_t TimingWheel::NIL;
+
+TimingWheel::TimingWheel():
+    current_tick_( 0 ),
+    size_( 0 ),
+    free_head_( NIL )
+{
+}
+
+void TimingWheel::init( uint32_t max_timers, uint64_t current_tick )
+{
+    current_tick_   = current_tick;
+    size_           = 0;
+
+    nodes_.clear();
+    nodes_.resize( max_timers );
+
+    slots_.assign( NUM_LEVELS * NUM_SLOTS, NIL );
+
+    // build the free list
+    free_head_  = NIL;
+
+    for( uint32_t i = max_timers; i > 0; --i )
+    {
+        auto & n = nodes_[ i - 1 ];
+
+        n.slot          = NIL;
+        n.generation    = 0;
+        n.next          = free_head_;
+
+        free_head_      = i - 1;
+    }
+}
+
+bool TimingWheel::insert( timer_id_t * timer_id, uint64_t expiry_tick, const Entry & e )
+{
+    if( free_head_ == NIL )
+        return false;
+
+    auto i = free_head_;
+
+    auto & n = nodes_[ i ];
+
+    free_head_      = n.next;
+
+    n.expiry_tick   = expiry_tick;
+    n.entry         = e;
+
+    // the current tick has been processed already
+    place( i, current_tick_ + 1 );
+
+    ++size_;
+
+    * timer_id  = ( static_cast<timer_id_t>( n.generation ) << 32 ) | i;
+
+    return true;
+}
+
+bool TimingWheel::cancel( timer_id_t timer_id )
+{
+    uint32_t i          = static_cast<uint32_t>( timer_id );
+    uint32_t generation = static_cast<uint32_t>( timer_id >> 32 );
+
+    if( i >= nodes_.size() )
+        return false;
+
+    auto & n = nodes_[ i ];
+
+    if( n.slot == NIL || n.generation != generation )
+        return false;
+
+    unlink( i );
+    release( i );
+
+    return true;
+}
+
+void TimingWheel::advance( uint64_t tick, std::vector<Entry> * expired )
+{
+    while( current_tick_ < tick )
+    {
+        ++current_tick_;
+
+        // cascade from the highest level whose period has completed, so that lower levels get the entries first
+        uint32_t level = 0;
+
+        while( level + 1 < NUM_LEVELS && ( ( current_tick_ >> ( SLOT_BITS * ( level + 1 ) ) ) << ( SLOT_BITS * ( level + 1 ) ) ) == current_tick_ )
+            ++level;
+
+        for( ; level > 0; --level )
+            cascade( level );
+
+        auto slot = static_cast<uint32_t>( current_tick_ & SLOT_MASK );
+
+        auto i = slots_[ slot ];
+
+        slots_[ slot ] = NIL;
+
+        while( i != NIL )
+        {
+            auto next = nodes_[ i ].next;
+
+            nodes_[ i ].slot = NIL;
+
+            if( nodes_[ i ].expiry_tick <= current_tick_ )
+            {
+                expired->push_back( nodes_[ i ].entry );
+
+                release( i );
+            }
+            else
+            {
+                // timer was too far in the future for the wheel
+                place( i, current_tick_ + 1 );
+            }
+
+            i = next;
+        }
+    }
+}
+
+uint64_t TimingWheel::get_current_tick() const
+{
+    return current_tick_;
+}
+
+uint32_t TimingWheel::size() const
+{
+    return size_;
+}
+
+void TimingWheel::place( uint32_t i, uint64_t min_tick )
+{
+    auto & n = nodes_[ i ];
+
+    auto expiry = ( n.expiry_tick > min_tick ) ? n.expiry_tick : min_tick;
+
+    auto delta  = expiry - current_tick_;
+
+    uint32_t level = 0;
+
+    while( level + 1 < NUM_LEVELS && delta >= ( 1ull << ( SLOT_BITS * ( level + 1 ) ) ) )
+        ++level;
+
+    if( delta >= ( 1ull << ( SLOT_BITS * NUM_LEVELS ) ) )
+    {
+        // beyond the range, park it in the farthest slot, it will be placed again on cascade
+        expiry  = current_tick_ + ( 1ull << ( SLOT_BITS * NUM_LEVELS ) ) - 1;
+    }
+
+    auto slot = static_cast<uint32_t>( ( expiry >> ( SLOT_BITS * level ) ) & SLOT_MASK );
+
+    link( level * NUM_SLOTS + slot, i );
+}
+
+void TimingWheel::link( uint32_t slot, uint32_t i )
+{
+    auto & n = nodes_[ i ];
+
+    n.slot  = slot;
+    n.prev  = NIL;
+    n.next  = slots_[ slot ];
+
+    if( n.next != NIL )
+        nodes_[ n.next ].prev = i;
+
+    slots_[ slot ] = i;
+}
+
+void TimingWheel::unlink( uint32_t i )
+{
+    auto & n = nodes_[ i ];
+
+    if( n.prev != NIL )
+        nodes_[ n.prev ].next = n.next;
+    else
+        slots_[ n.slot ] = n.next;
+
+    if( n.next != NIL )
+        nodes_[ n.next ].prev = n.prev;
+
+    n.slot  = NIL;
+}
+
+void TimingWheel::release( uint32_t i )
+{
+    auto & n = nodes_[ i ];
+
+    n.slot  = NIL;
+    ++n.generation;     // invalidates the timer id
+    n.next  = free_head_;
+
+    free_head_  = i;
+
+    --size_;
+}
+
+void TimingWheel::cascade( uint32_t level )
+{
+    auto slot = level * NUM_SLOTS + static_cast<uint32_t>( ( current_tick_ >> ( SLOT_BITS * level ) ) & SLOT_MASK );
+
+    auto i = slots_[ slot ];
+
+    slots_[ slot ] = NIL;
+
+    while( i != NIL )
+    {
+        auto next = nodes_[ i ].next;
+
+        // the current tick is processed after the cascade
+        place( i, current_tick_ );
+
+        i = next;
+    }
+}
+
+} // namespace simple_voip_wrap
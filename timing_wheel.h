@@ -0,0 +1,112 @@
+/*
+
+Simple VOIP Wrap. Hierarchical Timing Wheel.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13967 $ $Date:: 2020-10-10 #$ $Author: serge $
+
+#ifndef SIMPLE_VOIP_WRAP__TIMING_WHEEL_H
+#define SIMPLE_VOIP_WRAP__TIMING_WHEEL_H
+
+#include <vector>                           // std::vector
+#include <cstdint>                          // uint32_t
+
+namespace simple_voip_wrap {
+
+/**
+ * @brief Hierarchical timing wheel with a fixed number of timers.
+ *
+ * Time is measured in ticks, the owner decides how long a tick is and calls advance().
+ * Timers are stored in a preallocated pool, insert and cancel are O(1) and don't allocate.
+ * The class is not thread-safe.
+ */
+class TimingWheel
+{
+public:
+
+    typedef uint64_t    timer_id_t;
+
+    struct Entry
+    {
+        uint32_t    req_id;
+        uint32_t    call_id;
+        uint32_t    kind;
+    };
+
+public:
+    TimingWheel();
+
+    void init( uint32_t max_timers, uint64_t current_tick );
+
+    // returns false if all timers are in use
+    bool insert( timer_id_t * timer_id, uint64_t expiry_tick, const Entry & e );
+
+    // returns false if the timer has already expired or has been cancelled
+    bool cancel( timer_id_t timer_id );
+
+    // moves the time forward and appends the expired timers to the vector
+    void advance( uint64_t tick, std::vector<Entry> * expired );
+
+    uint64_t get_current_tick() const;
+    uint32_t size() const;
+
+private:
+
+    enum
+    {
+        SLOT_BITS   = 6,
+        NUM_SLOTS   = 1 << SLOT_BITS,
+        SLOT_MASK   = NUM_SLOTS - 1,
+        NUM_LEVELS  = 4,
+    };
+
+    static const uint32_t NIL = 0xFFFFFFFF;
+
+    struct Node
+    {
+        uint32_t    next;
+        uint32_t    prev;
+        uint32_t    slot;           // NIL if the node is free
+        uint32_t    generation;
+        uint64_t    expiry_tick;
+        Entry       entry;
+    };
+
+private:
+
+    void place( uint32_t i, uint64_t min_tick );
+    void link( uint32_t slot, uint32_t i );
+    void unlink( uint32_t i );
+    void release( uint32_t i );
+    void cascade( uint32_t level );
+
+private:
+
+    uint64_t            current_tick_;
+    uint32_t            size_;
+
+    uint32_t            free_head_;
+
+    std::vector<Node>       nodes_;
+    std::vector<uint32_t>   slots_;     // heads of the lists, NUM_LEVELS * NUM_SLOTS
+};
+
+} // namespace simple_voip_wrap
+
+#endif  // SIMPLE_VOIP_WRAP__TIMING_WHEEL_H
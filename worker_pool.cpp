@@ -0,0 +1,127 @@
+/*
+
+Simple VOIP Wrap. Worker Pool.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13962 $ $Date:: 2020-10-08 #$ $Author: serge $
+
+#include "worker_pool.h"                // self
+
+#include "utils/mutex_helper.h"         // MUTEX_SCOPE_LOCK
+
+namespace simple_voip_wrap {
+
+WorkerPool::WorkerPool():
+    is_running_( false )
+{
+}
+
+WorkerPool::~WorkerPool()
+{
+    shutdown();
+}
+
+bool WorkerPool::init(
+        uint32_t                            num_threads,
+        std::string                         * error_msg )
+{
+    if( num_threads == 0 )
+    {
+        * error_msg = "num_threads is 0";
+        return false;
+    }
+
+    MUTEX_SCOPE_LOCK( mutex_ );
+
+    if( is_running_ || threads_.empty() == false )
+    {
+        * error_msg = "already initialized";
+        return false;
+    }
+
+    is_running_ = true;
+
+    for( uint32_t i = 0; i < num_threads; ++i )
+    {
+        threads_.push_back( std::thread( & WorkerPool::thread_func, this ) );
+    }
+
+    return true;
+}
+
+bool WorkerPool::submit( const Task & task )
+{
+    {
+        MUTEX_SCOPE_LOCK( mutex_ );
+
+        if( is_running_ == false )
+            return false;
+
+        queue_.push_back( task );
+    }
+
+    cond_.notify_one();
+
+    return true;
+}
+
+void WorkerPool::shutdown()
+{
+    std::vector<std::thread> threads;
+
+    {
+        MUTEX_SCOPE_LOCK( mutex_ );
+
+        is_running_ = false;
+
+        queue_.clear();
+
+        threads.swap( threads_ );
+    }
+
+    cond_.notify_all();
+
+    for( auto & t : threads )
+        t.join();
+}
+
+void WorkerPool::thread_func()
+{
+    while( true )
+    {
+        Task task;
+
+        {
+            std::unique_lock<std::mutex> lock( mutex_ );
+
+            cond_.wait( lock, [this]{ return is_running_ == false || queue_.empty() == false; } );
+
+            if( is_running_ == false )
+                return;
+
+            task = std::move( queue_.front() );
+
+            queue_.pop_front();
+        }
+
+        task();
+    }
+}
+
+} // namespace simple_voip_wrap
@@ -0,0 +1,73 @@
+/*
+
+Simple VOIP Wrap. Worker Pool.
+
+Copyright (C) 2020 Sergey Kolevatov
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// $Revision: 13962 $ $Date:: 2020-10-08 #$ $Author: serge $
+
+#ifndef SIMPLE_VOIP_WRAP__WORKER_POOL_H
+#define SIMPLE_VOIP_WRAP__WORKER_POOL_H
+
+#include <mutex>                            // std::mutex
+#include <condition_variable>               // std::condition_variable
+#include <thread>                           // std::thread
+#include <functional>                       // std::function
+#include <deque>                            // std::deque
+#include <vector>                           // std::vector
+#include <string>                           // std::string
+#include <cstdint>                          // uint32_t
+
+namespace simple_voip_wrap {
+
+class WorkerPool
+{
+public:
+    typedef std::function<void()>   Task;
+
+public:
+    WorkerPool();
+    ~WorkerPool();
+
+    bool init(
+            uint32_t                            num_threads,
+            std::string                         * error_msg );
+
+    // returns false if the pool is not running
+    bool submit( const Task & task );
+
+    // stops the threads, tasks which haven't been started yet are dropped
+    void shutdown();
+
+private:
+
+    void thread_func();
+
+private:
+    mutable std::mutex          mutex_;
+    std::condition_variable     cond_;
+
+    bool                        is_running_;
+
+    std::deque<Task>            queue_;
+    std::vector<std::thread>    threads_;
+};
+
+} // namespace simple_voip_wrap
+
+#endif  // SIMPLE_VOIP_WRAP__WORKER_POOL_H
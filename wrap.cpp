@@ -19,13 +19,15 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 */
 
-// $Revision: 10613 $ $Date:: 2019-03-10 #$ $Author: serge $
+// $Revision: 13978 $ $Date:: 2020-10-17 #$ $Author: serge $
 
 #include "wrap.h"                       // self
 
-#include <typeindex>                    // std::type_index
 #include <typeinfo>
 #include <unordered_map>
+#include <cmath>                        // std::ceil
+#include <algorithm>                    // std::min
+#include <stdexcept>                    // std::exception
 
 #include "utils/mutex_helper.h"         // MUTEX_SCOPE_LOCK
 #include "utils/dummy_logger.h"         // dummy_log
@@ -40,6 +42,9 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #define MODULENAME      "Wrap"
 
+// locks the shard, wait and hold time are measured if lock profiling is on
+#define SHARD_SCOPE_LOCK( _s )      ProfiledLock _shard_lock( ( _s ).mutex, config_.lock_profiling ? & ( _s ).lock_profile : nullptr )
+
 namespace simple_voip_wrap {
 
 Wrap::Wrap():
@@ -47,16 +52,31 @@ Wrap::Wrap():
     voips_( nullptr ), callback_( nullptr ),
     scheduler_( nullptr ),
     req_id_gen_( nullptr ),
-    gd_( nullptr )
+    gd_( nullptr ),
+    sweep_slots_( 0 )
 {
 }
 
 Wrap::~Wrap()
 {
+    shutdown();
+}
+
+bool Wrap::init(
+        unsigned int                        log_id,
+        simple_voip::ISimpleVoip            * voips,
+        simple_voip::ISimpleVoipCallback    * callback,
+        scheduler::IScheduler               * scheduler,
+        utils::IRequestIdGen                * req_id_gen,
+        IGetDuration                        * gd,
+        std::string                         * error_msg )
+{
+    return init( log_id, Config(), voips, callback, scheduler, req_id_gen, gd, error_msg );
 }
 
 bool Wrap::init(
         unsigned int                        log_id,
+        const Config                        & config,
         simple_voip::ISimpleVoip            * voips,
         simple_voip::ISimpleVoipCallback    * callback,
         scheduler::IScheduler               * scheduler,
@@ -78,355 +98,2550 @@ bool Wrap::init(
     if( callback_ != nullptr )
         return false;
 
+    if( config.num_shards == 0 )
+    {
+        * error_msg = "num_shards is 0";
+        return false;
+    }
+
+    if( config.max_pending_requests == 0 )
+    {
+        * error_msg = "max_pending_requests is 0";
+        return false;
+    }
+
+    if( config.max_filenames > 0 )
+    {
+        if( filenames_.init( config.max_filenames, error_msg ) == false )
+            return false;
+    }
+
     log_id_     = log_id;
+    config_     = config;
     voips_      = voips;
     callback_   = callback;
     scheduler_  = scheduler;
     req_id_gen_ = req_id_gen;
     gd_         = gd;
 
-    return true;
-}
+    start_time_ = std::chrono::steady_clock::now();
 
-void Wrap::consume( const simple_voip::ForwardObject* obj )
-{
-    MUTEX_SCOPE_LOCK( mutex_ );
+    for( uint32_t i = 0; i < config.num_shards; ++i )
+    {
+        shards_.push_back( std::unique_ptr<Shard>( new Shard ) );
+
+        shards_.back()->map_req_to_param.init( config.max_pending_requests );
 
-    typedef Wrap Type;
+        if( config.timer_tick_ms > 0 )
+            shards_.back()->wheel.init( config.max_pending_requests, 0 );
 
-    typedef void (Type::*PPMF)( const simple_voip::ForwardObject * r );
+        if( config.num_shards > 1 )
+        {
+            routes_.push_back( std::unique_ptr<Route>( new Route ) );
+
+            // req ids are spread over the routes independently of call ids, so leave a reserve
+            routes_.back()->map_req_to_shard_id.init( config.max_pending_requests * 2 );
+        }
+    }
 
-#define HANDLER_MAP_ENTRY(_v)       { typeid( simple_voip::wrap::_v ),            & Type::handle_##_v }
+    uint32_t tick_ms = config.timer_tick_ms;
 
-    static const std::unordered_map<std::type_index, PPMF> funcs =
+    if( config.pending_ttl_ms > 0 )
     {
-        HANDLER_MAP_ENTRY( PlayFileRequest ),
-        HANDLER_MAP_ENTRY( RecordFileRequest ),
-    };
+        if( tick_ms == 0 )
+            tick_ms = std::max( 1u, std::min( 100u, config.pending_ttl_ms / 4 ) );
 
-#undef HANDLER_MAP_ENTRY
+        // each slot is checked at least 4 times per ttl, so an entry expires at most ttl / 4 late
+        uint64_t capacity = shards_.front()->map_req_to_param.capacity();
 
-    auto it = funcs.find( typeid( * obj ) );
+        sweep_slots_ = std::min( capacity, std::max<uint64_t>( 16, ( capacity * tick_ms * 4 + config.pending_ttl_ms - 1 ) / config.pending_ttl_ms ) );
+    }
 
-    if( it != funcs.end() )
+    // the threads are started when the shards are ready
+    if( config.duration_threads > 0 )
     {
-        (this->*it->second)( obj );
-
-        release_message( obj );
+        if( duration_pool_.init( config.duration_threads, error_msg ) == false )
+        {
+            reset();
+            return false;
+        }
     }
-    else
+
+    if( tick_ms > 0 )
     {
-        voips_->consume( obj );
+        auto b = timer_thread_.init(
+                std::chrono::milliseconds( tick_ms ),
+                std::bind( & Wrap::handle_tick, this ),
+                error_msg );
+
+        if( b == false )
+        {
+            duration_pool_.shutdown();
+            reset();
+            return false;
+        }
     }
+
+    return true;
 }
 
-void Wrap::consume( const simple_voip::CallbackObject* obj )
+void Wrap::reset()
 {
-    MUTEX_SCOPE_LOCK( mutex_ );
+    voips_      = nullptr;
+    callback_   = nullptr;
+    scheduler_  = nullptr;
+    req_id_gen_ = nullptr;
+    gd_         = nullptr;
 
-    auto req_id = get_resp_id( obj );
+    shards_.clear();
+    routes_.clear();
 
-    dummy_log_trace( log_id_, "consume: %s, req_id %u", typeid( *obj ).name(), req_id );
+    sweep_slots_    = 0;
+}
 
-    auto it = map_req_to_param_.find( req_id );
+void Wrap::consume( const simple_voip::ForwardObject* obj )
+{
+    auto tag = ForwardDispatcher::get_tag( * obj );
 
-    if( it == map_req_to_param_.end() )
-    {
-        dummy_log_debug( log_id_, "consume: req_id %u - is not found in the request list", req_id );
+    num_forward_[ tag ].add();
 
-        callback_->consume( obj );
+    if( tag == ForwardDispatcher::UNKNOWN )
+    {
+        voips_->consume( obj );
         return;
     }
 
-    dummy_log_debug( log_id_, "consume: req_id %u - is found in the request list", req_id );
+    Prefetch pf;
+
+    prefetch( obj, tag, & pf );
+
+    Outbox outbox;
+
+    bool is_forwarded;
+
+    {
+        auto & shard = get_shard( get_call_id( obj, tag ) );
+
+        SHARD_SCOPE_LOCK( shard );
 
-    auto & p = it->second;
+        is_forwarded = handle_forward( obj, tag, & pf, & outbox );
+    }
 
-    handle( obj, p );
+    outbox.flush( voips_, callback_ );
 
-    map_req_to_param_.erase( it );
-    release_message( obj );
+    if( is_forwarded == false )
+        release_message( obj );
 }
 
-void Wrap::handle( const simple_voip::CallbackObject* obj, const Param & p )
+void Wrap::consume_batch( const simple_voip::ForwardObject * const * objs, size_t size )
 {
-    dummy_log_trace( log_id_, "handle(): %s", StrHelper::to_string( *obj ).c_str() );
+    Outbox outbox;
 
-    typedef Wrap Type;
+    outbox.reserve( size );
 
-    typedef void (Type::*PPMF)( const simple_voip::CallbackObject * r, const Param & p );
+    std::vector<uint32_t>   tags( size );
+    std::vector<Prefetch>   pfs( size );
+    std::vector<uint8_t>    is_forwarded( size, 0 );
 
-#define HANDLER_MAP_ENTRY(_v)       { typeid( simple_voip::_v ),            & Type::handle_##_v }
+    // intercepted messages since the last one which is passed through, shard id and index
+    std::vector<std::pair<uint32_t, size_t>>    run;
 
-    static const std::unordered_map<std::type_index, PPMF> funcs =
+    for( size_t i = 0; i <= size; ++i )
     {
-        HANDLER_MAP_ENTRY( ErrorResponse ),
-        HANDLER_MAP_ENTRY( RejectResponse ),
-        HANDLER_MAP_ENTRY( PlayFileResponse ),
-        HANDLER_MAP_ENTRY( PlayFileStopResponse ),
-        HANDLER_MAP_ENTRY( RecordFileResponse ),
-        HANDLER_MAP_ENTRY( RecordFileStopResponse ),
-    };
+        if( i < size )
+        {
+            auto tag = ForwardDispatcher::get_tag( * objs[ i ] );
 
-#undef HANDLER_MAP_ENTRY
+            tags[ i ]   = tag;
 
-    auto it = funcs.find( typeid( * obj ) );
+            num_forward_[ tag ].add();
 
-    if( it != funcs.end() )
-    {
-        (this->*it->second)( obj, p );
+            if( tag != ForwardDispatcher::UNKNOWN )
+            {
+                prefetch( objs[ i ], tag, & pfs[ i ] );
+
+                run.push_back( std::make_pair( get_call_id( objs[ i ], tag ) % shards_.size(), i ) );
+                continue;
+            }
+        }
+
+        // a message is passed through or the batch has ended, handle the run, each shard is locked once,
+        // the order is kept within the shard and so within the call
+        std::stable_sort( run.begin(), run.end(),
+                []( const std::pair<uint32_t, size_t> & a, const std::pair<uint32_t, size_t> & b ) { return a.first < b.first; } );
+
+        for( size_t j = 0; j < run.size(); )
+        {
+            auto & shard = * shards_[ run[ j ].first ];
+
+            SHARD_SCOPE_LOCK( shard );
+
+            auto shard_id = run[ j ].first;
+
+            for( ; j < run.size() && run[ j ].first == shard_id; ++j )
+            {
+                auto k = run[ j ].second;
+
+                is_forwarded[ k ] = handle_forward( objs[ k ], tags[ k ], & pfs[ k ], & outbox );
+            }
+        }
+
+        run.clear();
+
+        if( i < size )
+            outbox.add( objs[ i ] );
     }
-    else
+
+    outbox.flush( voips_, callback_ );
+
+    for( size_t i = 0; i < size; ++i )
     {
-        dummy_log_error( log_id_, "handle(): unknown type %s", typeid( *obj ).name() );
-        ASSERT( false );
+        if( tags[ i ] != ForwardDispatcher::UNKNOWN && is_forwarded[ i ] == 0 )
+            release_message( objs[ i ] );
     }
 }
 
-bool Wrap::shutdown()
+void Wrap::prefetch( const simple_voip::ForwardObject * obj, uint32_t tag, Prefetch * pf )
 {
-    dummy_log_debug( log_id_, "shutdown()" );
+    // durations are looked up here, so that a slow file system doesn't hold the shard
 
-    MUTEX_SCOPE_LOCK( mutex_ );
+    auto is_async = config_.duration_threads > 0;
 
-    return true;
-}
+    pf->filename_id = 0;
+    pf->duration    = 0;
+    pf->has_error   = false;
 
-void Wrap::release_message( const simple_voip::ForwardObject* obj )
-{
-    delete obj;
+    // a failed lookup is reported to the application as the request is handled, the request is released as usual
+    try
+    {
+        prefetch_durations( obj, tag, is_async, pf );
+    }
+    catch( std::exception & e )
+    {
+        dummy_log_error( log_id_, "prefetch: cannot get duration: %s", e.what() );
+
+        pf->has_error   = true;
+        pf->error_msg   = e.what();
+    }
 }
 
-void Wrap::release_message( const simple_voip::CallbackObject* obj )
+void Wrap::prefetch_durations( const simple_voip::ForwardObject * obj, uint32_t tag, bool is_async, Prefetch * pf )
 {
-    delete obj;
+    switch( tag )
+    {
+    case ForwardDispatcher::tag<simple_voip::wrap::PlayFileRequest>():
+    {
+        auto * req = static_cast< const simple_voip::wrap::PlayFileRequest *>( obj );
+
+        if( req->filename_id != 0 )
+        {
+            // an invalid id is rejected by start_play()
+            if( req->filename_id > filenames_.get_size() )
+                return;
+
+            pf->filename_id = req->filename_id;
+        }
+        else
+        {
+            pf->filename_id = filenames_.intern( req->filename );
+        }
+
+        if( is_async == false )
+            pf->duration    = pf->filename_id ? get_duration( pf->filename_id ) : get_duration( req->filename );
+    }
+        break;
+
+    case ForwardDispatcher::tag<simple_voip::wrap::PlayListRequest>():
+    {
+        auto * req = static_cast< const simple_voip::wrap::PlayListRequest *>( obj );
+
+        // all durations are resolved up front, so that the next file is started as soon as the previous one has stopped
+        if( is_async == false )
+        {
+            pf->durations.reserve( req->filenames.size() );
+
+            for( auto & f : req->filenames )
+                pf->durations.push_back( get_duration( f ) );
+        }
+    }
+        break;
+
+    default:
+        break;
+    }
 }
 
-void Wrap::handle_PlayFileRequest( const simple_voip::ForwardObject * rreq )
+bool Wrap::handle_forward( const simple_voip::ForwardObject * obj, uint32_t tag, Prefetch * pf, Outbox * outbox )
 {
-    auto * req = dynamic_cast< const simple_voip::wrap::PlayFileRequest *>( rreq );
+    // private: shard mutex must be locked
 
-    Param p;
+    switch( tag )
+    {
+    case ForwardDispatcher::tag<simple_voip::wrap::PlayFileRequest>():
+        handle_PlayFileRequest( obj, * pf, outbox );
+        break;
 
-    p.init( type_e::PlayFileRequest, req->req_id, req->call_id, 0, req->filename );
+    case ForwardDispatcher::tag<simple_voip::wrap::RecordFileRequest>():
+        handle_RecordFileRequest( obj, outbox );
+        break;
 
-    auto b = map_req_to_param_.insert( std::make_pair( req->req_id, p ) ).second;
+    case ForwardDispatcher::tag<simple_voip::DropRequest>():
+        handle_DropRequest( obj, outbox );
+        return true;
 
-    ASSERT( b );
+    case ForwardDispatcher::tag<simple_voip::wrap::PlayListRequest>():
+        handle_PlayListRequest( obj, pf, outbox );
+        break;
 
-    auto req2 = simple_voip::create_play_file_request( req->req_id, req->call_id, req->filename );
+    default:
+        dummy_log_error( log_id_, "handle_forward(): unknown type %s", typeid( *obj ).name() );
+        ASSERT( false );
+        break;
+    }
 
-    voips_->consume( req2 );
+    return false;
 }
 
-void Wrap::handle_RecordFileRequest( const simple_voip::ForwardObject * rreq )
+void Wrap::consume( const simple_voip::CallbackObject* obj )
 {
-    auto * req = dynamic_cast< const simple_voip::wrap::RecordFileRequest *>( rreq );
+    auto tag    = CallbackDispatcher::get_tag( * obj );
 
-    // private: no mutex lock
+    num_callback_[ tag ].add();
 
-    Param p;
+    // neither a response nor a call end, e.g. Dialing or Connected, nothing to look up
+    if( tag == CallbackDispatcher::UNKNOWN )
+    {
+        callback_->consume( obj );
+        return;
+    }
 
-    p.init( type_e::RecordFileRequest, req->req_id, req->call_id, req->duration, req->filename );
+    auto req_id = get_resp_id( obj, tag );
 
-    auto b = map_req_to_param_.insert( std::make_pair( req->req_id, p ) ).second;
+    dummy_log_trace( log_id_, "consume: %s, req_id %u", typeid( *obj ).name(), req_id );
 
-    ASSERT( b );
+    Outbox outbox;
 
-    auto req2 = simple_voip::create_record_file_request( req->req_id, req->call_id, req->filename );
+    uint32_t call_id;
 
-    voips_->consume( req2 );
-}
+    if( get_ended_call_id( obj, tag, & call_id ) )
+    {
+        handle_call_end( call_id, & outbox );
 
-uint32_t Wrap::get_resp_id( const simple_voip::CallbackObject * obj )
-{
-    auto & type = typeid( *obj );
+        outbox.flush( voips_, callback_ );
 
-#define GET_RESP_ID_IF_TYPE(_v) if( type == typeid( simple_voip::_v ) ) { return dynamic_cast< const simple_voip::_v *>( obj )->req_id; }
+        callback_->consume( obj );
+        return;
+    }
 
-    GET_RESP_ID_IF_TYPE( ErrorResponse ) else
-    GET_RESP_ID_IF_TYPE( RejectResponse ) else
-    GET_RESP_ID_IF_TYPE( PlayFileResponse ) else
-    GET_RESP_ID_IF_TYPE( PlayFileStopResponse ) else
-    GET_RESP_ID_IF_TYPE( RecordFileResponse ) else
-    GET_RESP_ID_IF_TYPE( RecordFileStopResponse );
+    auto * shard = find_shard_by_req_id( req_id );
 
-    return 0;
-}
+    bool is_handled         = false;
+    bool is_passed_through  = false;
 
-void Wrap::handle_error( type_e type, uint32_t req_id, uint32_t orig_req_id, uint32_t call_id, uint32_t errorcode, const std::string & error_msg )
-{
-    switch( type )
-    {
-    case type_e::PlayFileRequest:
+    if( shard != nullptr )
     {
-        auto * resp = simple_voip::wrap::create_PlayFileStopped( call_id, req_id, errorcode, error_msg );
+        SHARD_SCOPE_LOCK( * shard );
 
-        callback_->consume( resp );
+        is_handled = handle_response( * shard, obj, tag, req_id, & outbox, & is_passed_through );
     }
-        break;
 
-    case type_e::PlayFileStopRequest:   // despite the error return a correct response
+    // downstream and callback are called without lock
+    if( is_handled )
     {
-        auto * resp = simple_voip::wrap::create_PlayFileStopped( call_id, orig_req_id, 0, "" );
+        outbox.flush( voips_, callback_ );
+
+        if( is_passed_through )
+            callback_->consume( obj );
+        else
+            release_message( obj );
 
-        callback_->consume( resp );
+        return;
     }
-        break;
 
-    case type_e::RecordFileRequest:
-    {
-        auto * resp = simple_voip::wrap::create_RecordFileStopped( call_id, req_id, errorcode, error_msg );
+    dummy_log_debug( log_id_, "consume: req_id %u - is not found in the request list", req_id );
 
-        callback_->consume( resp );
-    }
-        break;
+    callback_->consume( obj );
+}
 
-    case type_e::RecordFileStopRequest: // despite the error return a correct response
+void Wrap::consume_batch( const simple_voip::CallbackObject * const * objs, size_t size )
+{
+    Outbox outbox;
+
+    outbox.reserve( size );
+
+    std::vector<uint32_t>   tags( size );
+    std::vector<uint8_t>    is_released( size, 0 );
+
+    // responses since the last message which is handled separately, shard id and index
+    std::vector<std::pair<uint32_t, size_t>>    run;
+
+    for( size_t i = 0; i <= size; ++i )
     {
-        auto * resp = simple_voip::wrap::create_RecordFileStopped( call_id, orig_req_id, 0, "" );
+        uint32_t call_id    = 0;
+        bool is_call_end    = false;
 
-        callback_->consume( resp );
-    }
-        break;
+        if( i < size )
+        {
+            auto tag = CallbackDispatcher::get_tag( * objs[ i ] );
 
-    default:
-        break;
+            tags[ i ]   = tag;
+
+            num_callback_[ tag ].add();
+
+            is_call_end = get_ended_call_id( objs[ i ], tag, & call_id );
+
+            uint32_t shard_id;
+
+            if( tag != CallbackDispatcher::UNKNOWN && is_call_end == false && find_shard_id_by_req_id( get_resp_id( objs[ i ], tag ), & shard_id ) )
+            {
+                run.push_back( std::make_pair( shard_id, i ) );
+                continue;
+            }
+        }
+
+        // call end, unknown response or end of the batch, handle the run, each shard is locked once,
+        // the order is kept within the shard and so within the call
+        std::stable_sort( run.begin(), run.end(),
+                []( const std::pair<uint32_t, size_t> & a, const std::pair<uint32_t, size_t> & b ) { return a.first < b.first; } );
+
+        for( size_t j = 0; j < run.size(); )
+        {
+            auto & shard = * shards_[ run[ j ].first ];
+
+            SHARD_SCOPE_LOCK( shard );
+
+            auto shard_id = run[ j ].first;
+
+            for( ; j < run.size() && run[ j ].first == shard_id; ++j )
+            {
+                auto k      = run[ j ].second;
+                auto * obj  = objs[ k ];
+
+                bool is_passed_through  = false;
+
+                if( handle_response( shard, obj, tags[ k ], get_resp_id( obj, tags[ k ] ), & outbox, & is_passed_through ) == false || is_passed_through )
+                    outbox.add( obj );
+                else
+                    is_released[ k ] = 1;
+            }
+        }
+
+        run.clear();
+
+        if( i == size )
+            break;
+
+        if( is_call_end )
+            handle_call_end( call_id, & outbox );
+
+        outbox.add( objs[ i ] );
     }
-}
 
-// ISimpleVoipCallback interface
-void Wrap::handle_RejectResponse( const simple_voip::CallbackObject * oobj, const Param & p )
-{
-    auto * obj = dynamic_cast< const simple_voip::RejectResponse *>( oobj );
+    outbox.flush( voips_, callback_ );
 
-    handle_error( p.type, obj->req_id, p.start_req_id, p.call_id, 0, "rejected" );
+    for( size_t i = 0; i < size; ++i )
+    {
+        if( is_released[ i ] )
+            release_message( objs[ i ] );
+    }
 }
 
-void Wrap::handle_ErrorResponse( const simple_voip::CallbackObject * oobj, const Param & p )
+bool Wrap::handle_response( Shard & shard, const simple_voip::CallbackObject * obj, uint32_t tag, uint32_t req_id, Outbox * outbox, bool * is_passed_through )
 {
-    auto * obj = dynamic_cast< const simple_voip::ErrorResponse *>( oobj );
+    // private: shard mutex must be locked
 
-    handle_error( p.type, obj->req_id, p.start_req_id, p.call_id, obj->errorcode, obj->descr );
-}
+    auto * pp = shard.map_req_to_param.find( req_id );
 
-void Wrap::handle_PlayFileResponse( const simple_voip::CallbackObject * oobj, const Param & p )
-{
-    auto duration = gd_->get_duration( p.filename );
+    if( pp == nullptr )
+        return false;
 
-    dummy_log_trace( log_id_, "handle(): PlayFileResponse: filename %s, duration %.2f sec", p.filename.c_str(), duration );
+    dummy_log_debug( log_id_, "consume: req_id %u - is found in the request list", req_id );
 
-    std::string error_msg;
+    // handler may insert a new entry with the same req_id, so erase the current one before
+    auto p = std::move( * pp );
 
-    auto b = schedule_stop_event( p.start_req_id, p.call_id, duration, false, & error_msg );
+    erase_pending( shard, req_id );
 
-    if( b == false )
+    if( p.is_purged )
+    {
+        dummy_log_debug( log_id_, "consume: req_id %u - call %u has ended, response is dropped", req_id, p.call_id );
+    }
+    else if( p.is_expired )
+    {
+        handle_late_response( shard, tag, req_id, p, outbox );
+    }
+    else if( p.type == type_e::DropRequest )
     {
-        auto * resp = simple_voip::wrap::create_PlayFileStopped( p.call_id, p.start_req_id, simple_voip::wrap::ErrorCodes::SCHEDULER_ERROR, error_msg );
+        // the application gets the response as is, the call state is cleaned up on success
+        if( tag == CallbackDispatcher::tag<simple_voip::DropResponse>() )
+        {
+            purge_call( shard, p.call_id, outbox );
+        }
 
-        callback_->consume( resp );
+        * is_passed_through = true;
+    }
+    else
+    {
+        handle( obj, tag, p, outbox );
     }
-}
 
-void Wrap::handle_PlayFileStopResponse( const simple_voip::CallbackObject * oobj, const Param & p )
-{
-    auto * resp = simple_voip::wrap::create_PlayFileStopped( p.call_id, p.start_req_id, 0, "" );
+    num_callback_intercepted_.add();
 
-    callback_->consume( resp );
+    return true;
 }
 
-void Wrap::handle_RecordFileResponse( const simple_voip::CallbackObject * oobj, const Param & p )
+void Wrap::handle( const simple_voip::CallbackObject* obj, uint32_t tag, const Param & p, Outbox * outbox )
 {
-    std::string error_msg;
+    // formatting is skipped unless tracing is on
+    if( dummy_logger::is_enabled( log_id_, log_levels_log4j::TRACE ) )
+        dummy_log_trace( log_id_, "handle(): %s", StrHelper::to_cstr( *obj ) );
 
-    auto b = schedule_stop_event( p.start_req_id, p.call_id, p.duration, true, & error_msg );
-
-    if( b == false )
+    switch( tag )
     {
-        auto * resp = simple_voip::wrap::create_RecordFileStopped( p.call_id, p.start_req_id, simple_voip::wrap::ErrorCodes::SCHEDULER_ERROR, error_msg );
+    case CallbackDispatcher::tag<simple_voip::ErrorResponse>():
+        handle_ErrorResponse( obj, p, outbox );
+        break;
+
+    case CallbackDispatcher::tag<simple_voip::RejectResponse>():
+        handle_RejectResponse( obj, p, outbox );
+        break;
+
+    case CallbackDispatcher::tag<simple_voip::PlayFileResponse>():
+        handle_PlayFileResponse( obj, p, outbox );
+        break;
+
+    case CallbackDispatcher::tag<simple_voip::PlayFileStopResponse>():
+        handle_PlayFileStopResponse( obj, p, outbox );
+        break;
+
+    case CallbackDispatcher::tag<simple_voip::RecordFileResponse>():
+        handle_RecordFileResponse( obj, p, outbox );
+        break;
+
+    case CallbackDispatcher::tag<simple_voip::RecordFileStopResponse>():
+        handle_RecordFileStopResponse( obj, p, outbox );
+        break;
 
-        callback_->consume( resp );
+    default:
+        dummy_log_error( log_id_, "handle(): unknown type %s", typeid( *obj ).name() );
+        ASSERT( false );
+        break;
     }
 }
 
-void Wrap::handle_RecordFileStopResponse( const simple_voip::CallbackObject * oobj, const Param & p )
+bool Wrap::shutdown()
 {
-    auto * resp = simple_voip::wrap::create_RecordFileStopped( p.call_id, p.start_req_id, 0, "" );
+    dummy_log_debug( log_id_, "shutdown()" );
+
+    // pool and timer threads acquire the shard mutexes, so they must be stopped without holding any
+    duration_pool_.shutdown();
+    timer_thread_.shutdown();
+
+    MUTEX_SCOPE_LOCK( mutex_ );
 
-    callback_->consume( resp );
+    return true;
 }
 
-bool Wrap::schedule_stop_event( uint32_t req_id, uint32_t call_id, double duration, bool is_record, std::string * error_msg )
+void Wrap::release_message( const simple_voip::ForwardObject* obj )
 {
-    dummy_log_trace( log_id_, "schedule_stop_event: req_id %u, call_id %u, duration %.2f sec, is_record %u", req_id, call_id, duration, (int)is_record );
-
-    scheduler::job_id_t sched_job_id;
+    delete obj;
+}
 
-    auto p1 = & Wrap::handle_generate_play_stop;
-    auto p2 = & Wrap::handle_generate_record_stop;
-    auto p = is_record ? p2 : p1;
+void Wrap::release_message( const simple_voip::CallbackObject* obj )
+{
+    delete obj;
+}
 
-    auto b = scheduler::create_and_insert_timeout_job(
-            & sched_job_id,
-            error_msg,
-            * scheduler_,
-            "timer_job",
-            scheduler::Duration( duration ),
-            std::bind( p, this, req_id, call_id ) );
+PendingStats Wrap::get_pending_stats() const
+{
+    PendingStats res = { 0, 0, 0, 0, 0 };
 
-    if( b == false )
-    {
-        dummy_log_error( log_id_, "cannot set timer: %s", error_msg->c_str() );
-    }
-    else
+    for( auto & s : shards_ )
     {
-        dummy_log_debug( log_id_, "scheduled execution in: %.02f sec", duration );
+        SHARD_SCOPE_LOCK( * s );
+
+        res.num_calls               += s->map_call_id_to_info.size();
+        res.num_pending             += s->map_req_to_param.size();
+        res.num_active_media        += s->num_active_media;
+        res.max_num_pending         += s->max_num_pending;
+        res.max_num_active_media    += s->max_num_active_media;
     }
 
-    return b;
+    return res;
 }
 
-void Wrap::handle_generate_play_stop( uint32_t start_req_id, uint32_t call_id )
+filename_id_t Wrap::intern_filename( const std::string & filename )
 {
-    dummy_log_trace( log_id_, "handle_generate_play_stop: start_req_id %u, call_id %u", start_req_id, call_id );
+    return filenames_.intern( filename );
+}
 
-    auto req_id = req_id_gen_->get_next_request_id();
+MetricsSnapshot Wrap::get_metrics() const
+{
+    static const char * forward_names[] =
+    {
+        "forward.PlayFileRequest",
+        "forward.RecordFileRequest",
+        "forward.DropRequest",
+        "forward.PlayListRequest",
+        "forward.passed_through",
+    };
 
-    dummy_log_debug( log_id_, "handle_generate_play_stop: req_id %u, start_req_id %u, call_id %u", req_id, start_req_id, call_id );
+    static const char * callback_names[] =
+    {
+        "callback.PlayFileResponse",
+        "callback.PlayFileStopResponse",
+        "callback.RecordFileResponse",
+        "callback.RecordFileStopResponse",
+        "callback.ErrorResponse",
+        "callback.RejectResponse",
+        "callback.DropResponse",
+        "callback.ConnectionLost",
+        "callback.other",
+    };
 
-    Param p;
+    static_assert( sizeof( forward_names ) / sizeof( forward_names[0] ) == ForwardDispatcher::UNKNOWN + 1, "forward_names don't match ForwardDispatcher" );
+    static_assert( sizeof( callback_names ) / sizeof( callback_names[0] ) == CallbackDispatcher::UNKNOWN + 1, "callback_names don't match CallbackDispatcher" );
 
-    p.init( type_e::PlayFileStopRequest, start_req_id, call_id, 0, "" );
+    MetricsSnapshot res;
 
-    auto b = map_req_to_param_.insert( std::make_pair( req_id, p ) ).second;
+    auto & c = res.counters;
 
-    ASSERT( b );
+    uint64_t num_callback = 0;
 
-    auto req2 = simple_voip::create_play_file_stop_request( req_id, p.call_id );
+    for( uint32_t i = 0; i <= ForwardDispatcher::UNKNOWN; ++i )
+        c.push_back( std::make_pair( forward_names[ i ], num_forward_[ i ].get() ) );
 
-    voips_->consume( req2 );
-}
+    for( uint32_t i = 0; i <= CallbackDispatcher::UNKNOWN; ++i )
+    {
+        auto n = num_callback_[ i ].get();
 
-void Wrap::handle_generate_record_stop( uint32_t start_req_id, uint32_t call_id )
-{
-    dummy_log_trace( log_id_, "handle_generate_record_stop: start_req_id %u, call_id %u", start_req_id, call_id );
+        num_callback += n;
 
-    auto req_id = req_id_gen_->get_next_request_id();
+        c.push_back( std::make_pair( callback_names[ i ], n ) );
+    }
 
-    dummy_log_debug( log_id_, "handle_generate_record_stop: req_id %u, start_req_id %u, call_id %u", req_id, start_req_id, call_id );
+    auto num_intercepted = num_callback_intercepted_.get();
 
-    Param p;
+    c.push_back( std::make_pair( "callback.intercepted", num_intercepted ) );
+    c.push_back( std::make_pair( "callback.passed_through", num_callback - std::min( num_callback, num_intercepted ) ) );
+    c.push_back( std::make_pair( "errors.scheduler", num_scheduler_errors_.get() ) );
+    c.push_back( std::make_pair( "errors.too_many_requests", num_too_many_requests_.get() ) );
+    c.push_back( std::make_pair( "errors.queue_full", num_media_queue_full_.get() ) );
+    c.push_back( std::make_pair( "errors.expired", num_expired_.get() ) );
+    c.push_back( std::make_pair( "media.queued", num_media_queued_.get() ) );
+    c.push_back( std::make_pair( "media.flushed", num_media_flushed_.get() ) );
+    c.push_back( std::make_pair( "filenames.interned", filenames_.get_size() ) );
+
+    auto ps = get_pending_stats();
 
-    p.init( type_e::RecordFileStopRequest, start_req_id, call_id, 0, "" );
+    c.push_back( std::make_pair( "pending.calls", ps.num_calls ) );
+    c.push_back( std::make_pair( "pending.requests", ps.num_pending ) );
+    c.push_back( std::make_pair( "pending.requests_max", ps.max_num_pending ) );
+    c.push_back( std::make_pair( "pending.active_media", ps.num_active_media ) );
+    c.push_back( std::make_pair( "pending.active_media_max", ps.max_num_active_media ) );
 
-    auto b = map_req_to_param_.insert( std::make_pair( req_id, p ) ).second;
+    auto ls = get_lock_stats();
 
-    ASSERT( b );
+    c.push_back( std::make_pair( "lock.locks", ls.num_locks ) );
+    c.push_back( std::make_pair( "lock.wait_ns", ls.wait_ns ) );
+    c.push_back( std::make_pair( "lock.hold_ns", ls.hold_ns ) );
+    c.push_back( std::make_pair( "lock.max_wait_ns", ls.max_wait_ns ) );
 
-    auto req2 = simple_voip::create_record_file_stop_request( req_id, p.call_id );
+    res.histograms.push_back( std::make_pair( "get_duration_us", duration_latency_.get() ) );
+    res.histograms.push_back( std::make_pair( "ack_latency_us", ack_latency_.get() ) );
+    res.histograms.push_back( std::make_pair( "stop_overshoot_us", stop_overshoot_.get() ) );
+    res.histograms.push_back( std::make_pair( "stop_undershoot_us", stop_undershoot_.get() ) );
 
-    voips_->consume( req2 );
+    return res;
 }
 
+LockStats Wrap::get_lock_stats() const
+{
+    LockStats res = { 0, 0, 0, 0 };
+
+    for( auto & s : shards_ )
+    {
+        auto st = s->lock_profile.get();
+
+        res.num_locks   += st.num_locks;
+        res.wait_ns     += st.wait_ns;
+        res.hold_ns     += st.hold_ns;
+
+        if( st.max_wait_ns > res.max_wait_ns )
+            res.max_wait_ns = st.max_wait_ns;
+    }
+
+    return res;
+}
+
+void Wrap::reset_lock_stats()
+{
+    for( auto & s : shards_ )
+        s->lock_profile.reset();
+}
+
+Wrap::Shard & Wrap::get_shard( uint32_t call_id )
+{
+    return * shards_[ call_id % shards_.size() ];
+}
+
+Wrap::Shard * Wrap::find_shard_by_req_id( uint32_t req_id )
+{
+    uint32_t shard_id;
+
+    if( find_shard_id_by_req_id( req_id, & shard_id ) == false )
+        return nullptr;
+
+    return shards_[ shard_id ].get();
+}
+
+bool Wrap::find_shard_id_by_req_id( uint32_t req_id, uint32_t * shard_id )
+{
+    if( routes_.empty() )
+    {
+        * shard_id = 0;
+        return true;
+    }
+
+    auto & route = * routes_[ req_id % routes_.size() ];
+
+    MUTEX_SCOPE_LOCK( route.mutex );
+
+    auto * p = route.map_req_to_shard_id.find( req_id );
+
+    if( p == nullptr )
+        return false;
+
+    * shard_id = * p;
+
+    return true;
+}
+
+bool Wrap::insert_pending( Shard & shard, uint32_t req_id, const Param & p )
+{
+    // private: shard mutex must be locked
+
+    if( shard.map_req_to_param.insert( req_id, p ) == false )
+    {
+        dummy_log_error( log_id_, "insert_pending: req_id %u - cannot insert, %u requests pending, duplicate or limit reached", req_id, shard.map_req_to_param.size() );
+        return false;
+    }
+
+    if( routes_.empty() == false )
+    {
+        auto & route = * routes_[ req_id % routes_.size() ];
+
+        MUTEX_SCOPE_LOCK( route.mutex );
+
+        if( route.map_req_to_shard_id.insert( req_id, p.call_id % shards_.size() ) == false )
+        {
+            dummy_log_error( log_id_, "insert_pending: req_id %u - cannot insert into route", req_id );
+
+            shard.map_req_to_param.erase( req_id );
+            return false;
+        }
+    }
+
+    set_ttl_start( shard.map_req_to_param.find( req_id ) );
+
+    shard.map_call_id_to_info[ p.call_id ].pending_req_ids.push_back( req_id );
+
+    update_max_num_pending( shard );
+
+    return true;
+}
+
+void Wrap::set_ttl_start( Param * p ) const
+{
+    // requests which are not timed by themselves, e.g. stops, are stamped here
+    if( config_.pending_ttl_ms > 0 && p->start_time == std::chrono::steady_clock::time_point() )
+        p->start_time = std::chrono::steady_clock::now();
+}
+
+void Wrap::erase_pending( Shard & shard, uint32_t req_id )
+{
+    // private: shard mutex must be locked
+
+    auto * pp = shard.map_req_to_param.find( req_id );
+
+    if( pp == nullptr )
+        return;
+
+    auto it = shard.map_call_id_to_info.find( pp->call_id );
+
+    if( it != shard.map_call_id_to_info.end() )
+    {
+        auto & ids = it->second.pending_req_ids;
+
+        for( auto & id : ids )
+        {
+            if( id == req_id )
+            {
+                id = ids.back();
+                ids.pop_back();
+                break;
+            }
+        }
+
+        erase_call_info_if_empty( shard, it );
+    }
+
+    if( routes_.empty() == false )
+    {
+        auto & route = * routes_[ req_id % routes_.size() ];
+
+        MUTEX_SCOPE_LOCK( route.mutex );
+
+        route.map_req_to_shard_id.erase( req_id );
+    }
+
+    shard.map_req_to_param.erase( req_id );
+}
+
+void Wrap::add_active_media( Shard & shard, uint32_t call_id, const ActiveMedia & m )
+{
+    // private: shard mutex must be locked
+
+    shard.map_call_id_to_info[ call_id ].active_media.push_back( m );
+
+    ++shard.num_active_media;
+
+    if( shard.num_active_media > shard.max_num_active_media )
+        shard.max_num_active_media = shard.num_active_media;
+}
+
+bool Wrap::remove_active_media( Shard & shard, uint32_t call_id, uint32_t start_req_id, ActiveMedia * removed )
+{
+    // private: shard mutex must be locked
+
+    auto it = shard.map_call_id_to_info.find( call_id );
+
+    if( it == shard.map_call_id_to_info.end() )
+        return false;
+
+    auto & media = it->second.active_media;
+
+    for( auto & m : media )
+    {
+        if( m.start_req_id == start_req_id )
+        {
+            * removed = m;
+
+            m = media.back();
+            media.pop_back();
+
+            --shard.num_active_media;
+
+            erase_call_info_if_empty( shard, it );
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Wrap::erase_call_info_if_empty( Shard & shard, MapCallIdToCallInfo::iterator it )
+{
+    // private: shard mutex must be locked
+
+    auto & ci = it->second;
+
+    if( ci.pending_req_ids.empty() && ci.active_media.empty() )
+    {
+        shard.map_call_id_to_info.erase( it );
+    }
+}
+
+void Wrap::handle_call_end( uint32_t call_id, Outbox * outbox )
+{
+    dummy_log_debug( log_id_, "handle_call_end: call_id %u", call_id );
+
+    auto & shard = get_shard( call_id );
+
+    SHARD_SCOPE_LOCK( shard );
+
+    purge_call( shard, call_id, outbox );
+}
+
+void Wrap::purge_call( Shard & shard, uint32_t call_id, Outbox * outbox )
+{
+    // private: shard mutex must be locked
+
+    // before the current media is reported, so that the next one isn't started
+    flush_media_queue( shard, call_id, outbox );
+
+    auto it = shard.map_call_id_to_info.find( call_id );
+
+    if( it == shard.map_call_id_to_info.end() )
+        return;
+
+    auto & ci = it->second;
+
+    dummy_log_debug( log_id_, "purge_call: call_id %u, pending requests %u, active media %u", call_id, (unsigned)ci.pending_req_ids.size(), (unsigned)ci.active_media.size() );
+
+    end_playlists( shard, call_id, outbox );
+
+    // pending requests are kept until the engine responds, but the application is notified now
+
+    for( auto req_id : ci.pending_req_ids )
+    {
+        auto * pp = shard.map_req_to_param.find( req_id );
+
+        if( pp == nullptr || pp->is_purged || pp->type == type_e::DropRequest )
+            continue;
+
+        pp->is_purged = true;
+
+        // the speculative timer is in the active media, it is reported below
+        if( pp->is_armed )
+            continue;
+
+        handle_error( pp->type, req_id, pp->start_req_id, call_id, simple_voip::wrap::ErrorCodes::CALL_ENDED, "call ended", outbox );
+    }
+
+    for( auto & m : ci.active_media )
+    {
+        cancel_stop_event( shard, m );
+
+        auto type = m.is_record ? type_e::RecordFileRequest : type_e::PlayFileRequest;
+
+        handle_error( type, m.start_req_id, m.start_req_id, call_id, simple_voip::wrap::ErrorCodes::CALL_ENDED, "call ended", outbox );
+    }
+
+    shard.num_active_media -= ci.active_media.size();
+
+    ci.active_media.clear();
+
+    erase_call_info_if_empty( shard, it );
+
+    erase_ended_playlists( shard, call_id );
+}
+
+void Wrap::handle_PlayFileRequest( const simple_voip::ForwardObject * rreq, const Prefetch & pf, Outbox * outbox )
+{
+    // private: shard mutex must be locked
+
+    auto * req = static_cast< const simple_voip::wrap::PlayFileRequest *>( rreq );
+
+    auto & shard = get_shard( req->call_id );
+
+    if( pf.has_error )
+    {
+        reject_media( req->req_id, req->call_id, media_e::PLAY, simple_voip::wrap::ErrorCodes::DURATION_UNAVAILABLE, pf.error_msg, outbox );
+        return;
+    }
+
+    // an invalid id is passed as is, so that start_play() rejects it
+    auto filename_id = req->filename_id ? req->filename_id : pf.filename_id;
+
+    QueuedMedia * m;
+
+    if( config_.max_queued_media > 0 && enqueue_media( shard, req->call_id, req->req_id, media_e::PLAY, & m, outbox ) )
+    {
+        // the filename is copied only if it is not interned
+        if( m != nullptr )
+        {
+            m->filename_id  = filename_id;
+            m->duration     = pf.duration;
+
+            if( filename_id == 0 )
+                m->filename = req->filename;
+        }
+        return;
+    }
+
+    start_play( shard, req->req_id, req->call_id, filename_id, req->filename, pf.duration, outbox );
+}
+
+void Wrap::handle_RecordFileRequest( const simple_voip::ForwardObject * rreq, Outbox * outbox )
+{
+    // private: shard mutex must be locked
+
+    auto * req = static_cast< const simple_voip::wrap::RecordFileRequest *>( rreq );
+
+    auto & shard = get_shard( req->call_id );
+
+    QueuedMedia * m;
+
+    if( config_.max_queued_media > 0 && enqueue_media( shard, req->call_id, req->req_id, media_e::RECORD, & m, outbox ) )
+    {
+        if( m != nullptr )
+        {
+            m->filename     = req->filename;
+            m->duration     = req->duration;
+        }
+        return;
+    }
+
+    start_record( shard, req->req_id, req->call_id, req->filename, req->duration, outbox );
+}
+
+void Wrap::start_play( Shard & shard, uint32_t req_id, uint32_t call_id, filename_id_t filename_id, const std::string & req_filename, double duration, Outbox * outbox )
+{
+    // private: shard mutex must be locked
+
+    auto is_async = config_.duration_threads > 0;
+
+    if( filename_id > filenames_.get_size() )
+    {
+        handle_error( type_e::PlayFileRequest, req_id, req_id, call_id, simple_voip::wrap::ErrorCodes::INVALID_FILENAME, "invalid filename id", outbox );
+        return;
+    }
+
+    // the interned copy is used from here, req_filename is empty if the id was given
+    auto & filename     = filename_id ? filenames_.get( filename_id ) : req_filename;
+
+    Param p;
+
+    // the duration has been looked up before the shard was locked, unless it is resolved on the pool
+    p.init( type_e::PlayFileRequest, req_id, call_id, is_async ? 0 : duration, filename_id, is_async == false );
+
+    p.start_time    = std::chrono::steady_clock::now();
+
+    if( insert_pending( shard, req_id, p ) == false )
+    {
+        handle_error( type_e::PlayFileRequest, req_id, req_id, call_id, simple_voip::wrap::ErrorCodes::TOO_MANY_REQUESTS, "too many pending requests", outbox );
+
+        num_too_many_requests_.add();
+        return;
+    }
+
+    if( is_async )
+    {
+        // speculative timer is armed when the duration is resolved
+        if( resolve_duration_async( req_id, call_id, filename_id, filename ) == false )
+        {
+            erase_pending( shard, req_id );
+
+            handle_error( type_e::PlayFileRequest, req_id, req_id, call_id, simple_voip::wrap::ErrorCodes::DURATION_UNAVAILABLE, "cannot resolve duration", outbox );
+            return;
+        }
+    }
+    else if( config_.speculative_stop_timers )
+    {
+        arm_speculative_stop_timer( shard.map_req_to_param.find( req_id ), false );
+    }
+
+    auto req2 = simple_voip::create_play_file_request( req_id, call_id, filename );
+
+    outbox->add( req2 );
+}
+
+void Wrap::start_record( Shard & shard, uint32_t req_id, uint32_t call_id, const std::string & filename, double duration, Outbox * outbox )
+{
+    // private: shard mutex must be locked
+
+    Param p;
+
+    p.init( type_e::RecordFileRequest, req_id, call_id, duration, 0 );
+
+    p.start_time    = std::chrono::steady_clock::now();
+
+    if( insert_pending( shard, req_id, p ) == false )
+    {
+        handle_error( type_e::RecordFileRequest, req_id, req_id, call_id, simple_voip::wrap::ErrorCodes::TOO_MANY_REQUESTS, "too many pending requests", outbox );
+
+        num_too_many_requests_.add();
+        return;
+    }
+
+    if( config_.speculative_stop_timers )
+    {
+        arm_speculative_stop_timer( shard.map_req_to_param.find( req_id ), true );
+    }
+
+    auto req2 = simple_voip::create_record_file_request( req_id, call_id, filename );
+
+    outbox->add( req2 );
+}
+
+bool Wrap::enqueue_media( Shard & shard, uint32_t call_id, uint32_t req_id, media_e media, QueuedMedia ** item, Outbox * outbox )
+{
+    // private: shard mutex must be locked
+
+    * item  = nullptr;
+
+    auto it = shard.map_call_id_to_queue.find( call_id );
+
+    if( it == shard.map_call_id_to_queue.end() )
+    {
+        // nothing is in progress, the request is started now
+        shard.map_call_id_to_queue[ call_id ].current_req_id = req_id;
+
+        return false;
+    }
+
+    auto & q = it->second;
+
+    if( q.items.size() >= config_.max_queued_media )
+    {
+        dummy_log_warn( log_id_, "enqueue_media: req_id %u - media queue of call %u is full", req_id, call_id );
+
+        num_media_queue_full_.add();
+
+        reject_media( req_id, call_id, media, simple_voip::wrap::ErrorCodes::QUEUE_FULL, "media queue is full", outbox );
+
+        return true;
+    }
+
+    q.items.push_back( QueuedMedia() );
+
+    auto & m = q.items.back();
+
+    m.req_id        = req_id;
+    m.media         = media;
+    m.filename_id   = 0;
+    m.duration      = 0;
+
+    * item  = & m;
+
+    dummy_log_debug( log_id_, "enqueue_media: req_id %u, call_id %u, media %u, queued %u", req_id, call_id, (unsigned)media, (unsigned)q.items.size() );
+
+    num_media_queued_.add();
+
+    return true;
+}
+
+void Wrap::reject_media( uint32_t req_id, uint32_t call_id, media_e media, uint32_t errorcode, const std::string & error_msg, Outbox * outbox )
+{
+    // private: shard mutex must be locked
+
+    if( media == media_e::PLAYLIST )
+    {
+        outbox->add( simple_voip::wrap::create_PlayListStopped( call_id, req_id, 0, errorcode, error_msg ) );
+        return;
+    }
+
+    handle_error( media == media_e::RECORD ? type_e::RecordFileRequest : type_e::PlayFileRequest, req_id, req_id, call_id,
+            errorcode, error_msg, outbox );
+}
+
+void Wrap::start_next_media( Shard & shard, uint32_t call_id, uint32_t start_req_id, Outbox * outbox )
+{
+    // private: shard mutex must be locked
+
+    if( shard.map_call_id_to_queue.empty() )
+        return;
+
+    auto it = shard.map_call_id_to_queue.find( call_id );
+
+    if( it == shard.map_call_id_to_queue.end() || it->second.current_req_id != start_req_id )
+        return;
+
+    auto & q = it->second;
+
+    if( q.items.empty() )
+    {
+        shard.map_call_id_to_queue.erase( it );
+        return;
+    }
+
+    auto m = std::move( q.items.front() );
+
+    q.items.pop_front();
+
+    q.current_req_id    = m.req_id;
+
+    dummy_log_debug( log_id_, "start_next_media: req_id %u, call_id %u, media %u", m.req_id, call_id, (unsigned)m.media );
+
+    // a request which fails immediately starts the next one from its error path
+    switch( m.media )
+    {
+    case media_e::PLAY:
+        start_play( shard, m.req_id, call_id, m.filename_id, m.filename, m.duration, outbox );
+        break;
+    case media_e::RECORD:
+        start_record( shard, m.req_id, call_id, m.filename, m.duration, outbox );
+        break;
+    case media_e::PLAYLIST:
+        start_playlist( shard, m.req_id, call_id, m.filenames, std::move( m.durations ), outbox );
+        break;
+    }
+}
+
+void Wrap::flush_media_queue( Shard & shard, uint32_t call_id, Outbox * outbox )
+{
+    // private: shard mutex must be locked
+
+    auto it = shard.map_call_id_to_queue.find( call_id );
+
+    if( it == shard.map_call_id_to_queue.end() )
+        return;
+
+    // erased first, so that the stop of the current media doesn't start anything
+    auto items = std::move( it->second.items );
+
+    shard.map_call_id_to_queue.erase( it );
+
+    for( auto & m : items )
+    {
+        reject_media( m.req_id, call_id, m.media, simple_voip::wrap::ErrorCodes::CALL_ENDED, "call ended", outbox );
+    }
+
+    num_media_flushed_.add( items.size() );
+}
+
+void Wrap::handle_DropRequest( const simple_voip::ForwardObject * rreq, Outbox * outbox )
+{
+    // private: shard mutex must be locked
+
+    auto * req = static_cast< const simple_voip::DropRequest *>( rreq );
+
+    auto & shard = get_shard( req->call_id );
+
+    // queued media is not started anymore, the current one is reported when the call is cleaned up
+    flush_media_queue( shard, req->call_id, outbox );
+
+    Param p;
+
+    p.init( type_e::DropRequest, req->req_id, req->call_id, 0, 0 );
+
+    // the request is tracked only to clean up the call on DropResponse, forward it anyway
+    if( insert_pending( shard, req->req_id, p ) == false )
+    {
+        dummy_log_warn( log_id_, "handle_DropRequest: req_id %u - call %u won't be cleaned up on drop", req->req_id, req->call_id );
+    }
+
+    // the engine gets the original object, the pending entry keeps the call_id for DropResponse
+    outbox->add( rreq );
+}
+
+void Wrap::handle_PlayListRequest( const simple_voip::ForwardObject * rreq, Prefetch * pf, Outbox * outbox )
+{
+    // private: shard mutex must be locked
+
+    auto * req = static_cast< const simple_voip::wrap::PlayListRequest *>( rreq );
+
+    if( req->filenames.empty() )
+    {
+        outbox->add( simple_voip::wrap::create_PlayListStopped( req->call_id, req->req_id, 0, 0, "" ) );
+        return;
+    }
+
+    if( pf->has_error )
+    {
+        reject_media( req->req_id, req->call_id, media_e::PLAYLIST, simple_voip::wrap::ErrorCodes::DURATION_UNAVAILABLE, pf->error_msg, outbox );
+        return;
+    }
+
+    auto & shard = get_shard( req->call_id );
+
+    auto filenames = std::make_shared<const std::vector<std::string>>( req->filenames );
+
+    QueuedMedia * m;
+
+    // the whole list is the current media of the call until it is stopped
+    if( config_.max_queued_media > 0 && enqueue_media( shard, req->call_id, req->req_id, media_e::PLAYLIST, & m, outbox ) )
+    {
+        if( m != nullptr )
+        {
+            m->filenames    = std::move( filenames );
+            m->durations    = std::move( pf->durations );
+        }
+        return;
+    }
+
+    start_playlist( shard, req->req_id, req->call_id, filenames, std::move( pf->durations ), outbox );
+}
+
+void Wrap::start_playlist( Shard & shard, uint32_t req_id, uint32_t call_id, const std::shared_ptr<const std::vector<std::string>> & filenames, std::vector<double> && durations, Outbox * outbox )
+{
+    // private: shard mutex must be locked
+
+    auto is_async = config_.duration_threads > 0;
+
+    PlayList l;
+
+    l.req_id    = req_id;
+    l.call_id   = call_id;
+    l.index     = 0;
+    l.is_ended  = false;
+    l.is_unresolved = false;
+    l.filenames = filenames;
+    l.durations = std::move( durations );
+
+    auto item_req_id = req_id_gen_->get_next_request_id();
+
+    // submitted first, the results are ignored if the list cannot be started
+    if( is_async && resolve_playlist_async( req_id, call_id, l.filenames ) == false )
+    {
+        stop_playlist( shard, req_id, call_id, 0, simple_voip::wrap::ErrorCodes::DURATION_UNAVAILABLE, "cannot resolve durations", outbox );
+        return;
+    }
+
+    if( send_playlist_item( shard, item_req_id, l, outbox ) == false )
+    {
+        stop_playlist( shard, req_id, call_id, 0, simple_voip::wrap::ErrorCodes::TOO_MANY_REQUESTS, "too many pending requests", outbox );
+        return;
+    }
+
+    insert_playlist( shard, item_req_id, std::move( l ) );
+}
+
+bool Wrap::send_playlist_item( Shard & shard, uint32_t req_id, const PlayList & l, Outbox * outbox )
+{
+    // private: shard mutex must be locked
+
+    auto has_duration   = l.index < l.durations.size();
+
+    auto & filename     = ( * l.filenames )[ l.index ];
+
+    dummy_log_debug( log_id_, "send_playlist_item: req_id %u, list req_id %u, index %u, filename %s", req_id, l.req_id, l.index, filename.c_str() );
+
+    Param p;
+
+    // durations of a list are resolved by the list, so the file is not interned, the table is kept for prompts
+    p.init( type_e::PlayFileRequest, req_id, l.call_id, has_duration ? l.durations[ l.index ] : 0, 0, has_duration );
+
+    p.start_time    = std::chrono::steady_clock::now();
+
+    if( insert_pending( shard, req_id, p ) == false )
+    {
+        num_too_many_requests_.add();
+        return false;
+    }
+
+    if( has_duration && config_.speculative_stop_timers )
+    {
+        arm_speculative_stop_timer( shard.map_req_to_param.find( req_id ), false );
+    }
+
+    outbox->add( simple_voip::create_play_file_request( req_id, l.call_id, filename ) );
+
+    return true;
+}
+
+bool Wrap::resolve_playlist_async( uint32_t req_id, uint32_t call_id, const std::shared_ptr<const std::vector<std::string>> & filenames )
+{
+    // private: shard mutex must be locked
+
+    auto b = duration_pool_.submit(
+            [this, req_id, call_id, filenames]()
+            {
+                // each file gets its duration as soon as it is resolved, the first one doesn't wait for the rest
+                for( uint32_t i = 0; i < filenames->size(); ++i )
+                {
+                    double duration;
+
+                    try
+                    {
+                        duration = get_duration( ( * filenames )[ i ] );
+                    }
+                    catch( std::exception & e )
+                    {
+                        on_playlist_duration_failed( req_id, call_id, i, e.what() );
+                        return;
+                    }
+
+                    if( on_playlist_duration_resolved( req_id, call_id, i, duration ) == false )
+                        return;
+                }
+            } );
+
+    if( b == false )
+    {
+        dummy_log_warn( log_id_, "resolve_playlist_async: req_id %u - cannot submit, pool is stopped", req_id );
+    }
+
+    return b;
+}
+
+bool Wrap::on_playlist_duration_resolved( uint32_t req_id, uint32_t call_id, uint32_t index, double duration )
+{
+    uint32_t play_req_id;
+
+    {
+        auto & shard = get_shard( call_id );
+
+        SHARD_SCOPE_LOCK( shard );
+
+        auto it = find_playlist( shard, req_id, call_id );
+
+        if( it == shard.map_req_to_playlist.end() )
+        {
+            dummy_log_debug( log_id_, "on_playlist_duration_resolved: req_id %u - play list has ended, ignored", req_id );
+            return false;
+        }
+
+        auto & l = it->second;
+
+        ASSERT( l.durations.size() == index );
+
+        l.durations.push_back( duration );
+
+        // a later file gets it when it is sent
+        if( l.index != index )
+            return true;
+
+        play_req_id = it->first;
+    }
+
+    // the current file has been sent without it, it is handled as a single play
+    on_duration_resolved( play_req_id, call_id, duration );
+
+    return true;
+}
+
+void Wrap::on_playlist_duration_failed( uint32_t req_id, uint32_t call_id, uint32_t index, const std::string & error_msg )
+{
+    uint32_t play_req_id;
+
+    {
+        auto & shard = get_shard( call_id );
+
+        SHARD_SCOPE_LOCK( shard );
+
+        auto it = find_playlist( shard, req_id, call_id );
+
+        if( it == shard.map_req_to_playlist.end() )
+            return;
+
+        auto & l = it->second;
+
+        // the list is stopped when it reaches the file
+        l.is_unresolved = true;
+
+        if( l.index != index )
+            return;
+
+        play_req_id = it->first;
+    }
+
+    on_duration_failed( play_req_id, call_id, error_msg );
+}
+
+Wrap::MapReqIdToPlayList::iterator Wrap::find_playlist( Shard & shard, uint32_t req_id, uint32_t call_id )
+{
+    // private: shard mutex must be locked
+
+    auto it_ids = shard.map_call_id_to_playlist_req_ids.find( call_id );
+
+    if( it_ids != shard.map_call_id_to_playlist_req_ids.end() )
+    {
+        for( auto play_req_id : it_ids->second )
+        {
+            auto it = shard.map_req_to_playlist.find( play_req_id );
+
+            if( it != shard.map_req_to_playlist.end() && it->second.req_id == req_id && it->second.is_ended == false )
+                return it;
+        }
+    }
+
+    return shard.map_req_to_playlist.end();
+}
+
+void Wrap::continue_playlist( Shard & shard, MapReqIdToPlayList::iterator it, uint32_t errorcode, const std::string & error_msg, Outbox * outbox )
+{
+    // private: shard mutex must be locked
+
+    auto l = std::move( it->second );
+
+    erase_playlist( shard, it );
+
+    if( l.is_ended )
+        return;
+
+    if( errorcode != 0 )
+    {
+        stop_playlist( shard, l.req_id, l.call_id, l.index, errorcode, error_msg, outbox );
+        return;
+    }
+
+    ++l.index;
+
+    if( l.index == l.filenames->size() )
+    {
+        stop_playlist( shard, l.req_id, l.call_id, l.index, 0, "", outbox );
+        return;
+    }
+
+    if( l.is_unresolved && l.index >= l.durations.size() )
+    {
+        stop_playlist( shard, l.req_id, l.call_id, l.index, simple_voip::wrap::ErrorCodes::DURATION_UNAVAILABLE, "cannot resolve duration", outbox );
+        return;
+    }
+
+    auto req_id = req_id_gen_->get_next_request_id();
+
+    if( send_playlist_item( shard, req_id, l, outbox ) == false )
+    {
+        stop_playlist( shard, l.req_id, l.call_id, l.index, simple_voip::wrap::ErrorCodes::TOO_MANY_REQUESTS, "too many pending requests", outbox );
+        return;
+    }
+
+    insert_playlist( shard, req_id, std::move( l ) );
+}
+
+void Wrap::insert_playlist( Shard & shard, uint32_t req_id, PlayList && l )
+{
+    // private: shard mutex must be locked
+
+    shard.map_call_id_to_playlist_req_ids[ l.call_id ].push_back( req_id );
+
+    shard.map_req_to_playlist.insert( std::make_pair( req_id, std::move( l ) ) );
+}
+
+void Wrap::erase_playlist( Shard & shard, MapReqIdToPlayList::iterator it )
+{
+    // private: shard mutex must be locked
+
+    auto it_ids = shard.map_call_id_to_playlist_req_ids.find( it->second.call_id );
+
+    if( it_ids != shard.map_call_id_to_playlist_req_ids.end() )
+    {
+        auto & ids = it_ids->second;
+
+        // a call has one or a few lists
+        auto it_id = std::find( ids.begin(), ids.end(), it->first );
+
+        if( it_id != ids.end() )
+        {
+            * it_id = ids.back();
+            ids.pop_back();
+        }
+
+        if( ids.empty() )
+            shard.map_call_id_to_playlist_req_ids.erase( it_ids );
+    }
+
+    shard.map_req_to_playlist.erase( it );
+}
+
+void Wrap::stop_playlist( Shard & shard, uint32_t req_id, uint32_t call_id, uint32_t index, uint32_t errorcode, const std::string & error_msg, Outbox * outbox )
+{
+    // private: shard mutex must be locked
+
+    // the next media goes to the engine before the application is notified
+    start_next_media( shard, call_id, req_id, outbox );
+
+    outbox->add( simple_voip::wrap::create_PlayListStopped( call_id, req_id, index, errorcode, error_msg ) );
+}
+
+void Wrap::end_playlists( Shard & shard, uint32_t call_id, Outbox * outbox )
+{
+    // private: shard mutex must be locked
+
+    auto it_ids = shard.map_call_id_to_playlist_req_ids.find( call_id );
+
+    if( it_ids == shard.map_call_id_to_playlist_req_ids.end() )
+        return;
+
+    for( auto req_id : it_ids->second )
+    {
+        auto it = shard.map_req_to_playlist.find( req_id );
+
+        ASSERT( it != shard.map_req_to_playlist.end() );
+
+        auto & l = it->second;
+
+        if( l.is_ended )
+            continue;
+
+        l.is_ended  = true;
+
+        outbox->add( simple_voip::wrap::create_PlayListStopped( call_id, l.req_id, l.index, simple_voip::wrap::ErrorCodes::CALL_ENDED, "call ended" ) );
+    }
+}
+
+void Wrap::erase_ended_playlists( Shard & shard, uint32_t call_id )
+{
+    // private: shard mutex must be locked
+
+    auto it_ids = shard.map_call_id_to_playlist_req_ids.find( call_id );
+
+    if( it_ids == shard.map_call_id_to_playlist_req_ids.end() )
+        return;
+
+    // erasing changes the list of ids, so it is taken first
+    auto ids = it_ids->second;
+
+    for( auto req_id : ids )
+    {
+        auto it = shard.map_req_to_playlist.find( req_id );
+
+        if( it != shard.map_req_to_playlist.end() && it->second.is_ended )
+            erase_playlist( shard, it );
+    }
+}
+
+uint32_t Wrap::get_call_id( const simple_voip::ForwardObject * obj, uint32_t tag )
+{
+#define GET_CALL_ID_IF_TAG(_v) case ForwardDispatcher::tag<_v>(): return static_cast< const _v *>( obj )->call_id;
+
+    switch( tag )
+    {
+    GET_CALL_ID_IF_TAG( simple_voip::wrap::PlayFileRequest )
+    GET_CALL_ID_IF_TAG( simple_voip::wrap::RecordFileRequest )
+    GET_CALL_ID_IF_TAG( simple_voip::DropRequest )
+    GET_CALL_ID_IF_TAG( simple_voip::wrap::PlayListRequest )
+    default:
+        break;
+    }
+
+#undef GET_CALL_ID_IF_TAG
+
+    return 0;
+}
+
+uint32_t Wrap::get_resp_id( const simple_voip::CallbackObject * obj, uint32_t tag )
+{
+#define GET_RESP_ID_IF_TAG(_v) case CallbackDispatcher::tag<simple_voip::_v>(): return static_cast< const simple_voip::_v *>( obj )->req_id;
+
+    switch( tag )
+    {
+    GET_RESP_ID_IF_TAG( ErrorResponse )
+    GET_RESP_ID_IF_TAG( RejectResponse )
+    GET_RESP_ID_IF_TAG( PlayFileResponse )
+    GET_RESP_ID_IF_TAG( PlayFileStopResponse )
+    GET_RESP_ID_IF_TAG( RecordFileResponse )
+    GET_RESP_ID_IF_TAG( RecordFileStopResponse )
+    GET_RESP_ID_IF_TAG( DropResponse )
+    default:
+        break;
+    }
+
+#undef GET_RESP_ID_IF_TAG
+
+    return 0;
+}
+
+bool Wrap::get_ended_call_id( const simple_voip::CallbackObject * obj, uint32_t tag, uint32_t * call_id )
+{
+    if( tag == CallbackDispatcher::tag<simple_voip::ConnectionLost>() )
+    {
+        * call_id = static_cast< const simple_voip::ConnectionLost *>( obj )->call_id;
+        return true;
+    }
+
+    return false;
+}
+
+void Wrap::handle_play_stopped( uint32_t call_id, uint32_t start_req_id, uint32_t errorcode, const std::string & error_msg, Outbox * outbox )
+{
+    // private: shard mutex must be locked
+
+    auto & shard = get_shard( call_id );
+
+    if( shard.map_req_to_playlist.empty() == false )
+    {
+        auto it = shard.map_req_to_playlist.find( start_req_id );
+
+        if( it != shard.map_req_to_playlist.end() )
+        {
+            continue_playlist( shard, it, errorcode, error_msg, outbox );
+            return;
+        }
+    }
+
+    // the next media goes to the engine before the application is notified
+    start_next_media( shard, call_id, start_req_id, outbox );
+
+    auto * resp = simple_voip::wrap::create_PlayFileStopped( call_id, start_req_id, errorcode, error_msg );
+
+    outbox->add( resp );
+}
+
+void Wrap::handle_record_stopped( uint32_t call_id, uint32_t start_req_id, uint32_t errorcode, const std::string & error_msg, Outbox * outbox )
+{
+    // private: shard mutex must be locked
+
+    start_next_media( get_shard( call_id ), call_id, start_req_id, outbox );
+
+    auto * resp = simple_voip::wrap::create_RecordFileStopped( call_id, start_req_id, errorcode, error_msg );
+
+    outbox->add( resp );
+}
+
+void Wrap::handle_error( type_e type, uint32_t req_id, uint32_t orig_req_id, uint32_t call_id, uint32_t errorcode, const std::string & error_msg, Outbox * outbox )
+{
+    switch( type )
+    {
+    case type_e::PlayFileRequest:
+        handle_play_stopped( call_id, req_id, errorcode, error_msg, outbox );
+        break;
+
+    case type_e::PlayFileStopRequest:   // despite the error return a correct response
+        handle_play_stopped( call_id, orig_req_id, 0, "", outbox );
+        break;
+
+    case type_e::RecordFileRequest:
+        handle_record_stopped( call_id, req_id, errorcode, error_msg, outbox );
+        break;
+
+    case type_e::RecordFileStopRequest: // despite the error return a correct response
+        handle_record_stopped( call_id, orig_req_id, 0, "", outbox );
+        break;
+
+    default:
+        break;
+    }
+}
+
+// ISimpleVoipCallback interface
+void Wrap::handle_RejectResponse( const simple_voip::CallbackObject * oobj, const Param & p, Outbox * outbox )
+{
+    auto * obj = static_cast< const simple_voip::RejectResponse *>( oobj );
+
+    if( disarm_speculative_stop_timer( p ) == false )
+        return;
+
+    handle_error( p.type, obj->req_id, p.start_req_id, p.call_id, 0, "rejected", outbox );
+}
+
+void Wrap::handle_ErrorResponse( const simple_voip::CallbackObject * oobj, const Param & p, Outbox * outbox )
+{
+    auto * obj = static_cast< const simple_voip::ErrorResponse *>( oobj );
+
+    if( disarm_speculative_stop_timer( p ) == false )
+        return;
+
+    handle_error( p.type, obj->req_id, p.start_req_id, p.call_id, obj->errorcode, obj->descr, outbox );
+}
+
+// the latency of every DURATION_SAMPLE_RATE-th lookup of a thread is measured, a cached lookup doesn't pay for the clock
+static bool is_duration_sampled()
+{
+    static const uint32_t DURATION_SAMPLE_RATE = 16;
+
+    static thread_local uint32_t n = 0;
+
+    return ( n++ % DURATION_SAMPLE_RATE ) == 0;
+}
+
+double Wrap::get_duration( const std::string & filename )
+{
+    if( is_duration_sampled() == false )
+        return gd_->get_duration( filename );
+
+    auto start = std::chrono::steady_clock::now();
+
+    auto res = gd_->get_duration( filename );
+
+    duration_latency_.add( std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start ).count() );
+
+    return res;
+}
+
+double Wrap::get_duration( filename_id_t filename_id )
+{
+    // the hash is computed once at interning
+    if( is_duration_sampled() == false )
+        return gd_->get_duration_hashed( filenames_.get( filename_id ), filenames_.get_hash( filename_id ) );
+
+    auto start = std::chrono::steady_clock::now();
+
+    auto res = gd_->get_duration_hashed( filenames_.get( filename_id ), filenames_.get_hash( filename_id ) );
+
+    duration_latency_.add( std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start ).count() );
+
+    return res;
+}
+
+const std::string & Wrap::get_filename( filename_id_t filename_id ) const
+{
+    static const std::string empty;
+
+    return filename_id ? filenames_.get( filename_id ) : empty;
+}
+
+bool Wrap::resolve_duration_async( uint32_t req_id, uint32_t call_id, filename_id_t filename_id, const std::string & filename )
+{
+    // private: shard mutex must be locked
+
+    bool b;
+
+    if( filename_id != 0 )
+    {
+        b = duration_pool_.submit(
+                [this, req_id, call_id, filename_id]()
+                {
+                    double duration;
+
+                    try
+                    {
+                        duration = get_duration( filename_id );
+                    }
+                    catch( std::exception & e )
+                    {
+                        on_duration_failed( req_id, call_id, e.what() );
+                        return;
+                    }
+
+                    on_duration_resolved( req_id, call_id, duration );
+                } );
+    }
+    else
+    {
+        b = duration_pool_.submit(
+                [this, req_id, call_id, filename]()
+                {
+                    double duration;
+
+                    try
+                    {
+                        duration = get_duration( filename );
+                    }
+                    catch( std::exception & e )
+                    {
+                        on_duration_failed( req_id, call_id, e.what() );
+                        return;
+                    }
+
+                    on_duration_resolved( req_id, call_id, duration );
+                } );
+    }
+
+    if( b == false )
+    {
+        dummy_log_warn( log_id_, "resolve_duration_async: req_id %u - cannot submit, pool is stopped", req_id );
+    }
+
+    return b;
+}
+
+void Wrap::on_duration_resolved( uint32_t req_id, uint32_t call_id, double duration )
+{
+    Outbox outbox;
+
+    {
+        auto & shard = get_shard( call_id );
+
+        SHARD_SCOPE_LOCK( shard );
+
+        auto * pp = shard.map_req_to_param.find( req_id );
+
+        if( pp == nullptr || pp->type != type_e::PlayFileRequest )
+        {
+            dummy_log_debug( log_id_, "on_duration_resolved: req_id %u - is not found in the request list, ignored", req_id );
+            return;
+        }
+
+        auto & p = * pp;
+
+        if( p.is_purged )
+        {
+            // the call has ended, the request is kept only while the engine's response is outstanding
+            if( p.is_acked )
+                erase_pending( shard, req_id );
+
+            return;
+        }
+
+        // the request has timed out, the tombstone waits only for the engine
+        if( p.is_expired )
+            return;
+
+        dummy_log_trace( log_id_, "on_duration_resolved: req_id %u, filename %s, duration %.2f sec, is_acked %u", req_id, get_filename( p.filename_id ).c_str(), duration, (int)p.is_acked );
+
+        if( p.is_acked == false )
+        {
+            // PlayFileResponse will use it
+            p.duration      = duration;
+            p.has_duration  = true;
+
+            if( config_.speculative_stop_timers )
+                arm_speculative_stop_timer( & p, false );
+
+            return;
+        }
+
+        // PlayFileResponse has already arrived and is waiting for the duration
+
+        auto p2 = std::move( p );
+
+        erase_pending( shard, req_id );
+
+        handle_play_duration( p2, duration, p2.mark_time, & outbox );
+    }
+
+    outbox.flush( voips_, callback_ );
+}
+
+void Wrap::on_duration_failed( uint32_t req_id, uint32_t call_id, const std::string & error_msg )
+{
+    dummy_log_error( log_id_, "on_duration_failed: req_id %u, call_id %u - %s", req_id, call_id, error_msg.c_str() );
+
+    Outbox outbox;
+
+    {
+        auto & shard = get_shard( call_id );
+
+        SHARD_SCOPE_LOCK( shard );
+
+        auto * pp = shard.map_req_to_param.find( req_id );
+
+        if( pp == nullptr || pp->type != type_e::PlayFileRequest || pp->is_expired )
+            return;
+
+        auto p = * pp;
+
+        if( p.is_acked )
+        {
+            erase_pending( shard, req_id );
+
+            if( p.is_purged == false )
+                abort_play( shard, p, simple_voip::wrap::ErrorCodes::DURATION_UNAVAILABLE, error_msg, & outbox );
+        }
+        else if( p.is_purged == false )
+        {
+            // the engine hasn't answered yet, the tombstone swallows its response and stops a late play
+            pp->is_expired  = true;
+
+            handle_error( type_e::PlayFileRequest, req_id, req_id, call_id, simple_voip::wrap::ErrorCodes::DURATION_UNAVAILABLE, error_msg, & outbox );
+        }
+    }
+
+    outbox.flush( voips_, callback_ );
+}
+
+void Wrap::handle_PlayFileResponse( const simple_voip::CallbackObject * oobj, const Param & p, Outbox * outbox )
+{
+    auto ack_time = std::chrono::steady_clock::now();
+
+    update_ack_latency( get_shard( p.call_id ), p, ack_time );
+
+    if( p.has_duration )
+    {
+        handle_play_duration( p, p.duration, ack_time, outbox );
+        return;
+    }
+
+    // without the pool every play has got its duration before it was sent, so it is still being resolved,
+    // keep the request until it is ready
+
+    dummy_log_debug( log_id_, "handle(): PlayFileResponse: req_id %u - duration is not resolved yet", p.start_req_id );
+
+    auto p2 = p;
+
+    p2.is_acked     = true;
+    p2.mark_time    = ack_time;
+
+    // the TTL is counted from the ack, so that the play is not kept forever if the duration never arrives
+    auto & shard = get_shard( p.call_id );
+
+    if( insert_pending( shard, p.start_req_id, p2 ) == false )
+    {
+        num_too_many_requests_.add();
+
+        abort_play( shard, p, simple_voip::wrap::ErrorCodes::TOO_MANY_REQUESTS, "too many pending requests", outbox );
+    }
+}
+
+void Wrap::handle_play_duration( const Param & p, double duration, std::chrono::steady_clock::time_point ack_time, Outbox * outbox )
+{
+    // private: shard mutex must be locked
+
+    dummy_log_trace( log_id_, "handle(): PlayFileResponse: filename %s, duration %.2f sec", get_filename( p.filename_id ).c_str(), duration );
+
+    arm_stop_timer( p, duration, false, ack_time, outbox );
+}
+
+void Wrap::handle_PlayFileStopResponse( const simple_voip::CallbackObject * oobj, const Param & p, Outbox * outbox )
+{
+    // the next file of a play list is started from here
+    handle_play_stopped( p.call_id, p.start_req_id, 0, "", outbox );
+}
+
+void Wrap::handle_RecordFileResponse( const simple_voip::CallbackObject * oobj, const Param & p, Outbox * outbox )
+{
+    auto ack_time = std::chrono::steady_clock::now();
+
+    update_ack_latency( get_shard( p.call_id ), p, ack_time );
+
+    arm_stop_timer( p, p.duration, true, ack_time, outbox );
+}
+
+void Wrap::handle_RecordFileStopResponse( const simple_voip::CallbackObject * oobj, const Param & p, Outbox * outbox )
+{
+    handle_record_stopped( p.call_id, p.start_req_id, 0, "", outbox );
+}
+
+std::chrono::steady_clock::time_point Wrap::get_deadline( const Param & p, double duration, std::chrono::steady_clock::time_point ack_time ) const
+{
+    // the engine has started the media somewhere between the request and the ack, take the middle
+    return p.start_time + ( ack_time - p.start_time ) / 2
+            + std::chrono::duration_cast<std::chrono::steady_clock::duration>( std::chrono::duration<double>( duration ) );
+}
+
+void Wrap::arm_stop_timer( const Param & p, double duration, bool is_record, std::chrono::steady_clock::time_point ack_time, Outbox * outbox )
+{
+    // private: shard mutex must be locked
+
+    auto deadline = get_deadline( p, duration, ack_time );
+
+    if( p.is_armed )
+    {
+        // speculative timer, correct its deadline by the actual ack latency
+        auto & shard = get_shard( p.call_id );
+
+        ActiveMedia m;
+
+        if( remove_active_media( shard, p.call_id, p.start_req_id, & m ) == false )
+        {
+            dummy_log_debug( log_id_, "arm_stop_timer: req_id %u - speculative timer has fired before the ack", p.start_req_id );
+
+            if( p.mark_time != std::chrono::steady_clock::time_point() )
+                update_stop_error( p.mark_time, deadline );
+
+            return;
+        }
+
+        cancel_stop_event( shard, m );
+    }
+
+    std::string error_msg;
+
+    auto b = schedule_stop_event( p.start_req_id, p.call_id, deadline, is_record, false, & error_msg );
+
+    if( b == false )
+    {
+        handle_error( p.type, p.start_req_id, p.start_req_id, p.call_id, simple_voip::wrap::ErrorCodes::SCHEDULER_ERROR, error_msg, outbox );
+
+        num_scheduler_errors_.add();
+    }
+}
+
+void Wrap::arm_speculative_stop_timer( Param * p, bool is_record )
+{
+    // private: shard mutex must be locked
+
+    auto ack_time = p->start_time + std::chrono::nanoseconds( get_shard( p->call_id ).avg_ack_latency_ns );
+
+    std::string error_msg;
+
+    // on failure the timer is armed on the ack as usual
+    p->is_armed = schedule_stop_event( p->start_req_id, p->call_id, get_deadline( * p, p->duration, ack_time ), is_record, true, & error_msg );
+}
+
+bool Wrap::disarm_speculative_stop_timer( const Param & p )
+{
+    // private: shard mutex must be locked
+
+    if( p.is_armed == false )
+        return true;
+
+    auto & shard = get_shard( p.call_id );
+
+    ActiveMedia m;
+
+    if( remove_active_media( shard, p.call_id, p.start_req_id, & m ) == false )
+    {
+        // the timer has fired, the application gets the stop response instead of the error
+        dummy_log_debug( log_id_, "disarm_speculative_stop_timer: req_id %u - timer has fired already, error is dropped", p.start_req_id );
+        return false;
+    }
+
+    cancel_stop_event( shard, m );
+
+    return true;
+}
+
+bool Wrap::schedule_stop_event( uint32_t req_id, uint32_t call_id, std::chrono::steady_clock::time_point deadline, bool is_record, bool is_provisional, std::string * error_msg )
+{
+    // private: shard mutex must be locked
+
+    auto now        = std::chrono::steady_clock::now();
+
+    // the deadline may have passed already if the ack was late
+    double duration = ( deadline > now ) ? std::chrono::duration<double>( deadline - now ).count() : 0;
+
+    dummy_log_trace( log_id_, "schedule_stop_event: req_id %u, call_id %u, remaining %.3f sec, is_record %u, is_provisional %u", req_id, call_id, duration, (int)is_record, (int)is_provisional );
+
+    ActiveMedia m   = { req_id, is_record, is_provisional, 0, 0, deadline };
+
+    bool b;
+
+    if( is_timing_wheel_enabled() )
+    {
+        auto & shard = get_shard( call_id );
+
+        auto ms = std::chrono::duration<double, std::milli>( deadline - start_time_ ).count();
+
+        auto expiry_tick = ( ms > 0 ) ? static_cast<uint64_t>( std::ceil( ms / config_.timer_tick_ms ) ) : 0;
+
+        TimingWheel::Entry e = { req_id, call_id, is_record ? 1u : 0u };
+
+        b = shard.wheel.insert( & m.timer_id, expiry_tick, e );
+
+        if( b == false )
+        {
+            * error_msg = "too many timers";
+        }
+    }
+    else
+    {
+        auto p1 = & Wrap::handle_generate_play_stop;
+        auto p2 = & Wrap::handle_generate_record_stop;
+        auto p = is_record ? p2 : p1;
+
+        b = scheduler::create_and_insert_timeout_job(
+                & m.job_id,
+                error_msg,
+                * scheduler_,
+                "timer_job",
+                scheduler::Duration( duration ),
+                std::bind( p, this, req_id, call_id ) );
+    }
+
+    if( b == false )
+    {
+        dummy_log_error( log_id_, "cannot set timer: %s", error_msg->c_str() );
+    }
+    else
+    {
+        dummy_log_debug( log_id_, "scheduled execution in: %.03f sec", duration );
+
+        add_active_media( get_shard( call_id ), call_id, m );
+    }
+
+    return b;
+}
+
+void Wrap::cancel_stop_event( Shard & shard, const ActiveMedia & m )
+{
+    // private: shard mutex must be locked
+
+    if( is_timing_wheel_enabled() )
+    {
+        shard.wheel.cancel( m.timer_id );
+        return;
+    }
+
+    std::string error_msg;
+
+    if( scheduler_->delete_job( m.job_id, & error_msg ) == false )
+    {
+        // the job may be already running, it won't find the media and will do nothing
+        dummy_log_debug( log_id_, "cancel_stop_event: cannot delete job %u: %s", m.job_id, error_msg.c_str() );
+    }
+}
+
+bool Wrap::is_timing_wheel_enabled() const
+{
+    return config_.timer_tick_ms > 0;
+}
+
+uint64_t Wrap::get_current_tick() const
+{
+    auto elapsed = std::chrono::steady_clock::now() - start_time_;
+
+    return std::chrono::duration_cast<std::chrono::milliseconds>( elapsed ).count() / config_.timer_tick_ms;
+}
+
+void Wrap::handle_tick()
+{
+    auto is_wheel   = is_timing_wheel_enabled();
+    auto tick       = is_wheel ? get_current_tick() : 0;
+    auto now        = std::chrono::steady_clock::now();
+
+    for( auto & s : shards_ )
+    {
+        auto & shard = * s;
+
+        Outbox outbox;
+
+        {
+            SHARD_SCOPE_LOCK( shard );
+
+            if( is_wheel )
+            {
+                expired_.clear();
+
+                shard.wheel.advance( tick, & expired_ );
+
+                if( expired_.empty() == false )
+                    generate_stops( shard, & expired_, & outbox );
+            }
+
+            if( sweep_slots_ > 0 )
+                sweep_expired( shard, now, & outbox );
+        }
+
+        outbox.flush( voips_, callback_ );
+    }
+}
+
+void Wrap::sweep_expired( Shard & shard, std::chrono::steady_clock::time_point now, Outbox * outbox )
+{
+    // private: shard mutex must be locked
+
+    auto & map      = shard.map_req_to_param;
+    auto capacity   = map.capacity();
+    auto ttl        = std::chrono::milliseconds( config_.pending_ttl_ms );
+
+    swept_.clear();
+
+    // bounded work per tick, the cursor wraps around the slots
+    for( uint32_t n = 0; n < sweep_slots_; ++n )
+    {
+        uint32_t req_id;
+
+        auto * pp = map.get_at( shard.sweep_pos, & req_id );
+
+        if( ++shard.sweep_pos == capacity )
+            shard.sweep_pos = 0;
+
+        if( pp != nullptr && pp->get_ttl_start() + ttl <= now )
+            swept_.push_back( req_id );
+    }
+
+    // erasing moves entries within the table, so they are expired after the scan
+    for( auto req_id : swept_ )
+        expire_pending( shard, req_id, outbox );
+}
+
+void Wrap::expire_pending( Shard & shard, uint32_t req_id, Outbox * outbox )
+{
+    // private: shard mutex must be locked
+
+    auto * pp = shard.map_req_to_param.find( req_id );
+
+    if( pp == nullptr )
+        return;
+
+    auto p = * pp;
+
+    erase_pending( shard, req_id );
+
+    // the tombstone is not needed anymore, the expiry has been counted already
+    if( p.is_expired )
+        return;
+
+    num_expired_.add();
+
+    dummy_log_warn( log_id_, "expire_pending: req_id %u, call_id %u, type %u - no response from the engine, is_purged %u", req_id, p.call_id, (unsigned)p.type, (int)p.is_purged );
+
+    // the application has been notified when the call ended
+    if( p.is_purged )
+        return;
+
+    if( p.type == type_e::DropRequest )
+    {
+        // the call is treated as dropped, otherwise its state would stay forever
+        purge_call( shard, p.call_id, outbox );
+        return;
+    }
+
+    if( p.is_acked )
+    {
+        // the engine is playing, but the duration hasn't been resolved in time
+        abort_play( shard, p, simple_voip::wrap::ErrorCodes::REQUEST_TIMEOUT, "duration is not resolved", outbox );
+        return;
+    }
+
+    // kept for another ttl, so that a late response is not passed to the application
+    auto tombstone = p;
+
+    tombstone.is_expired    = true;
+    tombstone.mark_time     = std::chrono::steady_clock::now();
+
+    if( insert_pending( shard, req_id, tombstone ) == false )
+    {
+        dummy_log_warn( log_id_, "expire_pending: req_id %u - late response won't be intercepted", req_id );
+    }
+
+    // same as ErrorResponse, if the speculative timer has fired, the application gets the stop instead
+    if( disarm_speculative_stop_timer( p ) == false )
+        return;
+
+    handle_error( p.type, req_id, p.start_req_id, p.call_id, simple_voip::wrap::ErrorCodes::REQUEST_TIMEOUT, "no response from the engine", outbox );
+}
+
+void Wrap::abort_play( Shard & shard, const Param & p, uint32_t errorcode, const std::string & error_msg, Outbox * outbox )
+{
+    // private: shard mutex must be locked
+
+    dummy_log_warn( log_id_, "abort_play: start_req_id %u, call_id %u - %s", p.start_req_id, p.call_id, error_msg.c_str() );
+
+    send_silent_stop( shard, p.start_req_id, p.call_id, false, outbox );
+
+    handle_error( type_e::PlayFileRequest, p.start_req_id, p.start_req_id, p.call_id, errorcode, error_msg, outbox );
+}
+
+void Wrap::handle_late_response( Shard & shard, uint32_t tag, uint32_t req_id, const Param & p, Outbox * outbox )
+{
+    // private: shard mutex must be locked
+
+    dummy_log_warn( log_id_, "handle_late_response: req_id %u, call_id %u, type %u - request has expired, response is dropped", req_id, p.call_id, (unsigned)p.type );
+
+    // the application has got REQUEST_TIMEOUT, but the engine has started the media, so it is stopped
+    if( tag == CallbackDispatcher::tag<simple_voip::PlayFileResponse>() )
+        send_silent_stop( shard, p.start_req_id, p.call_id, false, outbox );
+    else if( tag == CallbackDispatcher::tag<simple_voip::RecordFileResponse>() )
+        send_silent_stop( shard, p.start_req_id, p.call_id, true, outbox );
+}
+
+void Wrap::send_silent_stop( Shard & shard, uint32_t start_req_id, uint32_t call_id, bool is_record, Outbox * outbox )
+{
+    // private: shard mutex must be locked
+
+    auto req_id = req_id_gen_->get_next_request_id();
+
+    dummy_log_debug( log_id_, "send_silent_stop: req_id %u, start_req_id %u, call_id %u, is_record %u", req_id, start_req_id, call_id, (int)is_record );
+
+    auto type = is_record ? type_e::RecordFileStopRequest : type_e::PlayFileStopRequest;
+
+    Param p;
+
+    p.init( type, start_req_id, call_id, 0, 0 );
+
+    // the application has been notified already, so the response is dropped as for an ended call
+    p.is_purged = true;
+
+    if( insert_pending( shard, req_id, p ) == false )
+    {
+        dummy_log_warn( log_id_, "send_silent_stop: req_id %u - response won't be intercepted", req_id );
+    }
+
+    if( is_record )
+        outbox->add( simple_voip::create_record_file_stop_request( req_id, call_id ) );
+    else
+        outbox->add( simple_voip::create_play_file_stop_request( req_id, call_id ) );
+}
+
+void Wrap::handle_generate_play_stop( uint32_t start_req_id, uint32_t call_id )
+{
+    dummy_log_trace( log_id_, "handle_generate_play_stop: start_req_id %u, call_id %u", start_req_id, call_id );
+
+    Outbox outbox;
+
+    {
+        auto & shard = get_shard( call_id );
+
+        SHARD_SCOPE_LOCK( shard );
+
+        generate_stop( shard, start_req_id, call_id, false, & outbox );
+    }
+
+    outbox.flush( voips_, callback_ );
+}
+
+void Wrap::handle_generate_record_stop( uint32_t start_req_id, uint32_t call_id )
+{
+    dummy_log_trace( log_id_, "handle_generate_record_stop: start_req_id %u, call_id %u", start_req_id, call_id );
+
+    Outbox outbox;
+
+    {
+        auto & shard = get_shard( call_id );
+
+        SHARD_SCOPE_LOCK( shard );
+
+        generate_stop( shard, start_req_id, call_id, true, & outbox );
+    }
+
+    outbox.flush( voips_, callback_ );
+}
+
+void Wrap::generate_stop( Shard & shard, uint32_t start_req_id, uint32_t call_id, bool is_record, Outbox * outbox )
+{
+    // private: shard mutex must be locked
+
+    ActiveMedia m;
+
+    if( remove_active_media( shard, call_id, start_req_id, & m ) == false )
+    {
+        dummy_log_debug( log_id_, "generate_stop: start_req_id %u - is not active anymore, ignored", start_req_id );
+        return;
+    }
+
+    on_stop_sent( shard, m );
+
+    auto req_id = req_id_gen_->get_next_request_id();
+
+    dummy_log_debug( log_id_, "generate_stop: req_id %u, start_req_id %u, call_id %u, is_record %u", req_id, start_req_id, call_id, (int)is_record );
+
+    auto type = is_record ? type_e::RecordFileStopRequest : type_e::PlayFileStopRequest;
+
+    Param p;
+
+    p.init( type, start_req_id, call_id, 0, 0 );
+
+    if( insert_pending( shard, req_id, p ) == false )
+    {
+        // the stop request is sent anyway, but its response is not tracked, so report the stop now
+        handle_error( type, req_id, start_req_id, call_id, 0, "", outbox );
+    }
+
+    if( is_record )
+        outbox->add( simple_voip::create_record_file_stop_request( req_id, call_id ) );
+    else
+        outbox->add( simple_voip::create_play_file_stop_request( req_id, call_id ) );
+}
+
+void Wrap::generate_stops( Shard & shard, std::vector<TimingWheel::Entry> * entries, Outbox * outbox )
+{
+    // private: shard mutex must be locked
+
+    // skip the media which has been stopped or purged since the timer was set
+    size_t n = 0;
+
+    ActiveMedia m;
+
+    for( auto & e : * entries )
+    {
+        if( remove_active_media( shard, e.call_id, e.req_id, & m ) )
+        {
+            on_stop_sent( shard, m );
+
+            ( * entries )[ n++ ] = e;
+        }
+        else
+        {
+            dummy_log_debug( log_id_, "generate_stops: start_req_id %u - is not active anymore, ignored", e.req_id );
+        }
+    }
+
+    entries->resize( n );
+
+    if( n == 0 )
+        return;
+
+    dummy_log_debug( log_id_, "generate_stops: %u stop requests", (unsigned)n );
+
+    batch_req_ids_.resize( n );
+
+    for( auto & req_id : batch_req_ids_ )
+        req_id = req_id_gen_->get_next_request_id();
+
+    batch_is_tracked_.assign( n, 1 );
+
+    for( size_t i = 0; i < n; ++i )
+    {
+        auto & e = ( * entries )[ i ];
+
+        Param p;
+
+        p.init( e.kind ? type_e::RecordFileStopRequest : type_e::PlayFileStopRequest, e.req_id, e.call_id, 0, 0 );
+
+        // inserted directly, so it must be stamped here, same as in insert_pending
+        set_ttl_start( & p );
+
+        if( shard.map_req_to_param.insert( batch_req_ids_[ i ], p ) == false )
+        {
+            dummy_log_error( log_id_, "generate_stops: req_id %u - cannot insert, %u requests pending", batch_req_ids_[ i ], shard.map_req_to_param.size() );
+
+            batch_is_tracked_[ i ] = 0;
+        }
+    }
+
+    if( routes_.empty() == false )
+        insert_routes( shard, entries->front().call_id % shards_.size() );
+
+    update_max_num_pending( shard );
+
+    outbox->reserve( outbox->size() + n );
+
+    for( size_t i = 0; i < n; ++i )
+    {
+        auto & e        = ( * entries )[ i ];
+        auto req_id     = batch_req_ids_[ i ];
+        bool is_record  = e.kind != 0;
+
+        if( batch_is_tracked_[ i ] )
+        {
+            shard.map_call_id_to_info[ e.call_id ].pending_req_ids.push_back( req_id );
+        }
+        else
+        {
+            // the stop request is sent anyway, but its response is not tracked, so report the stop now
+            handle_error( is_record ? type_e::RecordFileStopRequest : type_e::PlayFileStopRequest, req_id, e.req_id, e.call_id, 0, "", outbox );
+        }
+
+        if( is_record )
+            outbox->add( simple_voip::create_record_file_stop_request( req_id, e.call_id ) );
+        else
+            outbox->add( simple_voip::create_play_file_stop_request( req_id, e.call_id ) );
+    }
+}
+
+void Wrap::insert_routes( Shard & shard, uint32_t shard_id )
+{
+    // private: shard mutex must be locked
+
+    auto num_routes = routes_.size();
+
+    // each route is locked once for the whole batch
+    for( size_t r = 0; r < num_routes; ++r )
+    {
+        bool has_ids = false;
+
+        for( size_t i = 0; i < batch_req_ids_.size() && has_ids == false; ++i )
+            has_ids = batch_is_tracked_[ i ] && ( batch_req_ids_[ i ] % num_routes ) == r;
+
+        if( has_ids == false )
+            continue;
+
+        auto & route = * routes_[ r ];
+
+        MUTEX_SCOPE_LOCK( route.mutex );
+
+        for( size_t i = 0; i < batch_req_ids_.size(); ++i )
+        {
+            auto req_id = batch_req_ids_[ i ];
+
+            if( batch_is_tracked_[ i ] == 0 || ( req_id % num_routes ) != r )
+                continue;
+
+            if( route.map_req_to_shard_id.insert( req_id, shard_id ) == false )
+            {
+                dummy_log_error( log_id_, "insert_routes: req_id %u - cannot insert into route", req_id );
+
+                shard.map_req_to_param.erase( req_id );
+
+                batch_is_tracked_[ i ] = 0;
+            }
+        }
+    }
+}
+
+void Wrap::update_max_num_pending( Shard & shard )
+{
+    // private: shard mutex must be locked
+
+    if( shard.map_req_to_param.size() > shard.max_num_pending )
+        shard.max_num_pending = shard.map_req_to_param.size();
+}
+
+void Wrap::update_ack_latency( Shard & shard, const Param & p, std::chrono::steady_clock::time_point ack_time )
+{
+    // private: shard mutex must be locked
+
+    auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>( ack_time - p.start_time ).count();
+
+    ack_latency_.add( latency / 1000 );
+
+    // exponential moving average, 1/8 weight of the new sample, kept per shard so that acks of different shards don't share a line
+    shard.avg_ack_latency_ns += ( latency - shard.avg_ack_latency_ns ) / 8;
+}
+
+void Wrap::on_stop_sent( Shard & shard, const ActiveMedia & m )
+{
+    // private: shard mutex must be locked
+
+    auto now = std::chrono::steady_clock::now();
+
+    if( m.is_provisional )
+    {
+        // the deadline is known only when the ack arrives, the error is measured then
+        auto * pp = shard.map_req_to_param.find( m.start_req_id );
+
+        if( pp != nullptr )
+            pp->mark_time = now;
+
+        return;
+    }
+
+    update_stop_error( now, m.deadline );
+}
+
+void Wrap::update_stop_error( std::chrono::steady_clock::time_point stop_time, std::chrono::steady_clock::time_point deadline )
+{
+    if( stop_time >= deadline )
+        stop_overshoot_.add( std::chrono::duration_cast<std::chrono::microseconds>( stop_time - deadline ).count() );
+    else
+        stop_undershoot_.add( std::chrono::duration_cast<std::chrono::microseconds>( deadline - stop_time ).count() );
+}
 
 } // namespace simple_voip_wrap
@@ -19,13 +19,19 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 */
 
-// $Revision: 9748 $ $Date:: 2018-09-21 #$ $Author: serge $
+// $Revision: 13978 $ $Date:: 2020-10-17 #$ $Author: serge $
 
 #ifndef SIMPLE_VOIP_WRAP__WRAP_H
 #define SIMPLE_VOIP_WRAP__WRAP_H
 
 #include <mutex>                            // std::mutex
-#include <map>                              // std::map
+#include <vector>                           // std::vector
+#include <deque>                            // std::deque
+#include <unordered_map>                    // std::unordered_map
+#include <memory>                           // std::unique_ptr, std::shared_ptr
+#include <chrono>                           // std::chrono
+#include <atomic>                           // std::atomic
+#include <type_traits>                      // std::is_trivially_copyable
 
 #include "scheduler/i_scheduler.h"          // IScheduler
 #include "objects.h"                        // simple_voip::InitiateCallRequest
@@ -34,9 +40,28 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include "utils/i_request_id_gen.h"         // utils::IRequestIdGen
 
 #include "i_get_duration.h"                 // IGetDuration
+#include "config.h"                         // Config
+#include "worker_pool.h"                    // WorkerPool
+#include "flat_req_id_map.h"                // FlatReqIdMap
+#include "outbox.h"                         // Outbox
+#include "timing_wheel.h"                   // TimingWheel
+#include "periodic_thread.h"                // PeriodicThread
+#include "type_dispatcher.h"                // TypeDispatcher
+#include "lock_profile.h"                   // LockProfile
+#include "metrics.h"                        // Counter
+#include "filename_table.h"                 // FilenameTable
 
 namespace simple_voip_wrap {
 
+struct PendingStats
+{
+    uint32_t    num_calls;              // calls with pending requests or active media
+    uint32_t    num_pending;            // requests waiting for the response of the engine
+    uint32_t    num_active_media;       // plays and records waiting for their stop timer
+    uint32_t    max_num_pending;        // high-water marks, sum of the per-shard maximums
+    uint32_t    max_num_active_media;
+};
+
 class Wrap:
     virtual public simple_voip::ISimpleVoip,
     virtual public simple_voip::ISimpleVoipCallback
@@ -54,90 +79,399 @@ public:
             IGetDuration                        * gd,
             std::string                         * error_msg );
 
+    bool init(
+            unsigned int                        log_id,
+            const Config                        & config,
+            simple_voip::ISimpleVoip            * voips,
+            simple_voip::ISimpleVoipCallback    * callback,
+            scheduler::IScheduler               * scheduler,
+            utils::IRequestIdGen                * req_id_gen,
+            IGetDuration                        * gd,
+            std::string                         * error_msg );
+
     // interface ISimpleVoip
     void consume( const simple_voip::ForwardObject* obj );
 
     // interface ISimpleVoipCallback
     void consume( const simple_voip::CallbackObject * obj );
 
+    // same as consume() for each message, but each shard is locked once for a run of messages,
+    // a message which is passed through ends the run, the order is kept within a call
+    void consume_batch( const simple_voip::ForwardObject * const * objs, size_t size );
+    void consume_batch( const simple_voip::CallbackObject * const * objs, size_t size );
+
     // interface threcon::IControllable
     bool shutdown();
 
     void release_message( const simple_voip::ForwardObject* obj );
     void release_message( const simple_voip::CallbackObject* obj );
 
+    PendingStats get_pending_stats() const;
+
+    // returns the id to be used in wrap::PlayFileRequest instead of the filename, 0 if the table is full or disabled,
+    // see Config::max_filenames
+    filename_id_t intern_filename( const std::string & filename );
+
+    // counters and histograms of the wrap, includes the pending and lock stats
+    MetricsSnapshot get_metrics() const;
+
+    // sum over the shard mutexes, zero unless Config::lock_profiling is set
+    LockStats get_lock_stats() const;
+    void reset_lock_stats();
+
 private:
 
-    enum class type_e
+    enum class type_e: uint8_t
     {
         PlayFileRequest,
         PlayFileStopRequest,
         RecordFileRequest,
-        RecordFileStopRequest
+        RecordFileStopRequest,
+        DropRequest
     };
 
     struct Param
     {
         type_e      type;
+        bool        has_duration:1; // duration is known, false while it is being resolved
+        bool        is_acked:1;     // PlayFileResponse has arrived before the duration was resolved
+        bool        is_purged:1;    // the call has ended, the response is swallowed
+        bool        is_expired:1;   // tombstone of a timed out request, see Config::pending_ttl_ms
+        bool        is_armed:1;     // speculative stop timer is set, see Config::speculative_stop_timers
         uint32_t    start_req_id;
         uint32_t    call_id;
+        filename_id_t   filename_id;    // 0 - not interned, then the duration is resolved when the request is sent
         double      duration;
-        std::string filename;
+        std::chrono::steady_clock::time_point   start_time;     // request has entered Wrap, the TTL is counted from it
+        // the states are exclusive, so one time point is kept for them:
+        // is_acked - the response has arrived, is_expired - the request has timed out, the TTL is counted from it,
+        // is_armed - the speculative timer has fired before the ack, if set
+        std::chrono::steady_clock::time_point   mark_time;
 
         void init(
             type_e              type,
             uint32_t            start_req_id,
             uint32_t            call_id,
             double              duration,
-            const std::string   & filename )
+            filename_id_t       filename_id,
+            bool                has_duration    = true )
         {
             this->type      = type;
             this->start_req_id  = start_req_id;
             this->call_id   = call_id;
             this->duration  = duration;
-            this->filename  = filename;
+            this->filename_id   = filename_id;
+            this->has_duration  = has_duration;
+            this->is_acked  = false;
+            this->is_purged = false;
+            this->is_expired    = false;
+            this->is_armed  = false;
+            this->start_time    = std::chrono::steady_clock::time_point();
+            this->mark_time     = std::chrono::steady_clock::time_point();
+        }
+
+        std::chrono::steady_clock::time_point get_ttl_start() const
+        {
+            return ( is_acked || is_expired ) ? mark_time : start_time;
+        }
+    };
+
+    // copied into and out of the flat table on each request
+    static_assert( std::is_trivially_copyable<Param>::value, "Param must be trivially copyable" );
+
+    typedef FlatReqIdMap<Param>             MapReqIdToParam;
+
+    // play or record which waits for its stop timer
+    struct ActiveMedia
+    {
+        uint32_t            start_req_id;
+        bool                is_record;
+        bool                is_provisional; // speculative timer, the ack hasn't arrived yet
+        scheduler::job_id_t job_id;     // if the scheduler is used for stop timers
+        TimingWheel::timer_id_t timer_id;   // if the timing wheel is used for stop timers
+        std::chrono::steady_clock::time_point   deadline;   // estimated end of the media
+    };
+
+    struct CallInfo
+    {
+        std::vector<uint32_t>       pending_req_ids;
+        std::vector<ActiveMedia>    active_media;
+    };
+
+    typedef std::unordered_map<uint32_t, CallInfo>  MapCallIdToCallInfo;
+
+    // play list which is run by Wrap, each file is a separate play with its own req_id
+    struct PlayList
+    {
+        uint32_t                    req_id;         // of PlayListRequest
+        uint32_t                    call_id;
+        uint32_t                    index;          // the file being played
+        bool                        is_ended;       // the call has ended, notifications of the current play are swallowed
+        bool                        is_unresolved;  // the pool has failed, the files after the last duration are not played
+        std::shared_ptr<const std::vector<std::string>> filenames;  // shared with the duration pool
+        std::vector<double>         durations;      // resolved so far, in order, the pool appends them one by one
+    };
+
+    // the key is the req_id of the current play
+    typedef std::unordered_map<uint32_t, PlayList>  MapReqIdToPlayList;
+
+    // keys of map_req_to_playlist by call, so that the lists of an ended call are found without a scan
+    typedef std::unordered_map<uint32_t, std::vector<uint32_t>> MapCallIdToPlayListReqIds;
+
+    enum class media_e
+    {
+        PLAY,
+        RECORD,
+        PLAYLIST,
+    };
+
+    // play, record or play list which waits in the media queue of its call, see Config::max_queued_media
+    struct QueuedMedia
+    {
+        uint32_t            req_id;
+        media_e             media;
+        filename_id_t       filename_id;    // of the play, if interned
+        std::string         filename;       // if not interned
+        double              duration;       // of the record, of the play unless it is resolved on the pool
+        std::shared_ptr<const std::vector<std::string>> filenames;  // of the play list
+        std::vector<double> durations;      // of the play list, unless they are resolved on the pool
+    };
+
+    // looked up before the shard is locked, see prefetch()
+    struct Prefetch
+    {
+        filename_id_t               filename_id;    // of a play
+        double                      duration;       // of a play, unless it is resolved on the pool
+        std::vector<double>         durations;      // of a play list, unless they are resolved on the pool
+
+        bool                        has_error;      // the lookup has thrown, the request is rejected
+        std::string                 error_msg;
+    };
+
+    // exists while a play or record of the call is in progress
+    struct MediaQueue
+    {
+        uint32_t                    current_req_id;
+        std::deque<QueuedMedia>     items;
+    };
+
+    typedef std::unordered_map<uint32_t, MediaQueue>    MapCallIdToMediaQueue;
+
+    // pending state of the calls which belong to this shard
+    struct Shard
+    {
+        Shard():
+            sweep_pos( 0 ),
+            num_active_media( 0 ),
+            max_num_pending( 0 ),
+            max_num_active_media( 0 ),
+            avg_ack_latency_ns( 0 )
+        {
         }
+
+        std::mutex                  mutex;
+
+        MapReqIdToParam             map_req_to_param;
+        MapCallIdToCallInfo         map_call_id_to_info;
+        MapReqIdToPlayList          map_req_to_playlist;
+        MapCallIdToPlayListReqIds   map_call_id_to_playlist_req_ids;
+        MapCallIdToMediaQueue       map_call_id_to_queue;
+
+        TimingWheel                 wheel;
+
+        LockProfile                 lock_profile;
+
+        uint32_t                    sweep_pos;              // next slot of map_req_to_param to check for expiry
+
+        uint32_t                    num_active_media;
+        uint32_t                    max_num_pending;        // high-water marks
+        uint32_t                    max_num_active_media;
+
+        int64_t                     avg_ack_latency_ns;     // moving average of the calls of the shard, used by speculative stop timers
     };
 
-    typedef std::map<uint32_t, Param>      MapReqIdToParam;
+    typedef FlatReqIdMap<uint32_t>          MapReqIdToShardId;
+
+    // intercepted requests
+    typedef TypeDispatcher<simple_voip::ForwardObject,
+            simple_voip::wrap::PlayFileRequest,
+            simple_voip::wrap::RecordFileRequest,
+            simple_voip::DropRequest,
+            simple_voip::wrap::PlayListRequest>     ForwardDispatcher;
+
+    // responses which may belong to a pending request and call end notifications, the most frequent first
+    typedef TypeDispatcher<simple_voip::CallbackObject,
+            simple_voip::PlayFileResponse,
+            simple_voip::PlayFileStopResponse,
+            simple_voip::RecordFileResponse,
+            simple_voip::RecordFileStopResponse,
+            simple_voip::ErrorResponse,
+            simple_voip::RejectResponse,
+            simple_voip::DropResponse,
+            simple_voip::ConnectionLost>            CallbackDispatcher;
+
+    // tells to which shard a pending req_id belongs, used only if there is more than one shard
+    struct Route
+    {
+        std::mutex                  mutex;
+
+        MapReqIdToShardId           map_req_to_shard_id;
+    };
 
 private:
 
-    uint32_t get_resp_id( const simple_voip::CallbackObject * obj );
+    // undoes a failed init(), the threads must not be running
+    void reset();
 
-    // simple_voip::ISimpleVoip interface
-    void handle_PlayFileRequest( const simple_voip::ForwardObject * req );
-    void handle_RecordFileRequest( const simple_voip::ForwardObject * req );
+    Shard & get_shard( uint32_t call_id );
+    Shard * find_shard_by_req_id( uint32_t req_id );
+    bool find_shard_id_by_req_id( uint32_t req_id, uint32_t * shard_id );
 
-    void handle( const simple_voip::CallbackObject * obj, const Param & p );
+    bool insert_pending( Shard & shard, uint32_t req_id, const Param & p );
+    void erase_pending( Shard & shard, uint32_t req_id );
+    void set_ttl_start( Param * p ) const;
 
-    // interface ISimpleVoipCallback
-    void handle_RejectResponse( const simple_voip::CallbackObject * obj, const Param & p );
-    void handle_ErrorResponse( const simple_voip::CallbackObject * obj, const Param & p );
-    void handle_PlayFileResponse( const simple_voip::CallbackObject * obj, const Param & p );
-    void handle_PlayFileStopResponse( const simple_voip::CallbackObject * obj, const Param & p );
-    void handle_RecordFileResponse( const simple_voip::CallbackObject * obj, const Param & p );
-    void handle_RecordFileStopResponse( const simple_voip::CallbackObject * obj, const Param & p );
+    void add_active_media( Shard & shard, uint32_t call_id, const ActiveMedia & m );
+    bool remove_active_media( Shard & shard, uint32_t call_id, uint32_t start_req_id, ActiveMedia * m );
+    void erase_call_info_if_empty( Shard & shard, MapCallIdToCallInfo::iterator it );
+
+    uint32_t get_call_id( const simple_voip::ForwardObject * obj, uint32_t tag );
+    uint32_t get_resp_id( const simple_voip::CallbackObject * obj, uint32_t tag );
+    bool get_ended_call_id( const simple_voip::CallbackObject * obj, uint32_t tag, uint32_t * call_id );
 
-    void handle_error( type_e type, uint32_t req_id, uint32_t orig_req_id, uint32_t call_id, uint32_t errorcode, const std::string & error_msg );
+    void handle_call_end( uint32_t call_id, Outbox * outbox );
+    void purge_call( Shard & shard, uint32_t call_id, Outbox * outbox );
 
-    bool schedule_stop_event( uint32_t req_id, uint32_t call_id, double duration, bool is_record, std::string * error_msg );
+    // simple_voip::ISimpleVoip interface
+    void prefetch( const simple_voip::ForwardObject * obj, uint32_t tag, Prefetch * pf );
+    void prefetch_durations( const simple_voip::ForwardObject * obj, uint32_t tag, bool is_async, Prefetch * pf );
+    // returns true if obj itself is passed to the engine, then it is not released
+    bool handle_forward( const simple_voip::ForwardObject * obj, uint32_t tag, Prefetch * pf, Outbox * outbox );
+    void handle_PlayFileRequest( const simple_voip::ForwardObject * req, const Prefetch & pf, Outbox * outbox );
+    void handle_RecordFileRequest( const simple_voip::ForwardObject * req, Outbox * outbox );
+    void handle_DropRequest( const simple_voip::ForwardObject * req, Outbox * outbox );
+    void handle_PlayListRequest( const simple_voip::ForwardObject * req, Prefetch * pf, Outbox * outbox );
+
+    void start_play( Shard & shard, uint32_t req_id, uint32_t call_id, filename_id_t filename_id, const std::string & filename, double duration, Outbox * outbox );
+    void start_record( Shard & shard, uint32_t req_id, uint32_t call_id, const std::string & filename, double duration, Outbox * outbox );
+
+    // returns false if nothing is in progress for the call and the request must be started now,
+    // otherwise the request is rejected or queued, the queued item is returned in item to be filled in
+    bool enqueue_media( Shard & shard, uint32_t call_id, uint32_t req_id, media_e media, QueuedMedia ** item, Outbox * outbox );
+    void reject_media( uint32_t req_id, uint32_t call_id, media_e media, uint32_t errorcode, const std::string & error_msg, Outbox * outbox );
+    void start_next_media( Shard & shard, uint32_t call_id, uint32_t start_req_id, Outbox * outbox );
+    void flush_media_queue( Shard & shard, uint32_t call_id, Outbox * outbox );
+
+    bool handle_response( Shard & shard, const simple_voip::CallbackObject * obj, uint32_t tag, uint32_t req_id, Outbox * outbox, bool * is_passed_through );
+    void handle( const simple_voip::CallbackObject * obj, uint32_t tag, const Param & p, Outbox * outbox );
+
+    // interface ISimpleVoipCallback
+    void handle_RejectResponse( const simple_voip::CallbackObject * obj, const Param & p, Outbox * outbox );
+    void handle_ErrorResponse( const simple_voip::CallbackObject * obj, const Param & p, Outbox * outbox );
+    void handle_PlayFileResponse( const simple_voip::CallbackObject * obj, const Param & p, Outbox * outbox );
+    void handle_PlayFileStopResponse( const simple_voip::CallbackObject * obj, const Param & p, Outbox * outbox );
+    void handle_RecordFileResponse( const simple_voip::CallbackObject * obj, const Param & p, Outbox * outbox );
+    void handle_RecordFileStopResponse( const simple_voip::CallbackObject * obj, const Param & p, Outbox * outbox );
+
+    double get_duration( const std::string & filename );
+    double get_duration( filename_id_t filename_id );
+    const std::string & get_filename( filename_id_t filename_id ) const;
+    bool resolve_duration_async( uint32_t req_id, uint32_t call_id, filename_id_t filename_id, const std::string & filename );
+    void on_duration_resolved( uint32_t req_id, uint32_t call_id, double duration );
+    void on_duration_failed( uint32_t req_id, uint32_t call_id, const std::string & error_msg );
+    void handle_play_duration( const Param & p, double duration, std::chrono::steady_clock::time_point ack_time, Outbox * outbox );
+
+    void start_playlist( Shard & shard, uint32_t req_id, uint32_t call_id, const std::shared_ptr<const std::vector<std::string>> & filenames, std::vector<double> && durations, Outbox * outbox );
+    bool send_playlist_item( Shard & shard, uint32_t req_id, const PlayList & l, Outbox * outbox );
+    void stop_playlist( Shard & shard, uint32_t req_id, uint32_t call_id, uint32_t index, uint32_t errorcode, const std::string & error_msg, Outbox * outbox );
+    bool resolve_playlist_async( uint32_t req_id, uint32_t call_id, const std::shared_ptr<const std::vector<std::string>> & filenames );
+    bool on_playlist_duration_resolved( uint32_t req_id, uint32_t call_id, uint32_t index, double duration );
+    void on_playlist_duration_failed( uint32_t req_id, uint32_t call_id, uint32_t index, const std::string & error_msg );
+    MapReqIdToPlayList::iterator find_playlist( Shard & shard, uint32_t req_id, uint32_t call_id );
+    void continue_playlist( Shard & shard, MapReqIdToPlayList::iterator it, uint32_t errorcode, const std::string & error_msg, Outbox * outbox );
+    void insert_playlist( Shard & shard, uint32_t req_id, PlayList && l );
+    void erase_playlist( Shard & shard, MapReqIdToPlayList::iterator it );
+    void end_playlists( Shard & shard, uint32_t call_id, Outbox * outbox );
+    void erase_ended_playlists( Shard & shard, uint32_t call_id );
+
+    void handle_play_stopped( uint32_t call_id, uint32_t start_req_id, uint32_t errorcode, const std::string & error_msg, Outbox * outbox );
+    void handle_record_stopped( uint32_t call_id, uint32_t start_req_id, uint32_t errorcode, const std::string & error_msg, Outbox * outbox );
+    void handle_error( type_e type, uint32_t req_id, uint32_t orig_req_id, uint32_t call_id, uint32_t errorcode, const std::string & error_msg, Outbox * outbox );
+
+    std::chrono::steady_clock::time_point get_deadline( const Param & p, double duration, std::chrono::steady_clock::time_point ack_time ) const;
+    void arm_stop_timer( const Param & p, double duration, bool is_record, std::chrono::steady_clock::time_point ack_time, Outbox * outbox );
+    void arm_speculative_stop_timer( Param * p, bool is_record );
+    bool disarm_speculative_stop_timer( const Param & p );
+    bool schedule_stop_event( uint32_t req_id, uint32_t call_id, std::chrono::steady_clock::time_point deadline, bool is_record, bool is_provisional, std::string * error_msg );
+    void cancel_stop_event( Shard & shard, const ActiveMedia & m );
+
+    bool is_timing_wheel_enabled() const;
+    uint64_t get_current_tick() const;
+    void handle_tick();
+    void sweep_expired( Shard & shard, std::chrono::steady_clock::time_point now, Outbox * outbox );
+    void expire_pending( Shard & shard, uint32_t req_id, Outbox * outbox );
+    void abort_play( Shard & shard, const Param & p, uint32_t errorcode, const std::string & error_msg, Outbox * outbox );
+    void handle_late_response( Shard & shard, uint32_t tag, uint32_t req_id, const Param & p, Outbox * outbox );
+    void send_silent_stop( Shard & shard, uint32_t start_req_id, uint32_t call_id, bool is_record, Outbox * outbox );
 
     void handle_generate_play_stop( uint32_t start_req_id, uint32_t call_id );
     void handle_generate_record_stop( uint32_t start_req_id, uint32_t call_id );
+    void generate_stop( Shard & shard, uint32_t start_req_id, uint32_t call_id, bool is_record, Outbox * outbox );
+    void generate_stops( Shard & shard, std::vector<TimingWheel::Entry> * entries, Outbox * outbox );
+    void insert_routes( Shard & shard, uint32_t shard_id );
+
+    static void update_max_num_pending( Shard & shard );
+    void update_ack_latency( Shard & shard, const Param & p, std::chrono::steady_clock::time_point ack_time );
+    void on_stop_sent( Shard & shard, const ActiveMedia & m );
+    void update_stop_error( std::chrono::steady_clock::time_point stop_time, std::chrono::steady_clock::time_point deadline );
 
 private:
-    mutable std::mutex          mutex_;
+    mutable std::mutex          mutex_;     // protects initialization, the pending state is protected by the shards
 
     unsigned int                log_id_;
 
+    Config                      config_;
+
     simple_voip::ISimpleVoip            * voips_;
     simple_voip::ISimpleVoipCallback    * callback_;
     scheduler::IScheduler               * scheduler_;
     utils::IRequestIdGen                * req_id_gen_;
     IGetDuration                        * gd_;
 
-    MapReqIdToParam             map_req_to_param_;
+    std::vector<std::unique_ptr<Shard>>     shards_;    // separate allocations, so that shards don't share cache lines
+    std::vector<std::unique_ptr<Route>>     routes_;
+
+    FilenameTable               filenames_;
+
+    std::chrono::steady_clock::time_point   start_time_;
+
+    // metrics, see get_metrics()
+    Counter                     num_forward_[ ForwardDispatcher::UNKNOWN + 1 ];     // by type, UNKNOWN - passed through
+    Counter                     num_callback_[ CallbackDispatcher::UNKNOWN + 1 ];   // by type, UNKNOWN - other types
+    Counter                     num_callback_intercepted_;      // responses to the pending requests
+    Counter                     num_scheduler_errors_;
+    Counter                     num_too_many_requests_;
+    Counter                     num_media_queued_;
+    Counter                     num_media_flushed_;             // queued media dropped on call end
+    Counter                     num_media_queue_full_;
+    Counter                     num_expired_;                   // pending requests removed by the sweeper
+    Histogram                   duration_latency_;              // get_duration, us, 1 of 16 lookups of a thread
+    Histogram                   ack_latency_;                   // from the request to its ack, us
+    Histogram                   stop_overshoot_;                // stop sent after the estimated end of the media, us
+    Histogram                   stop_undershoot_;               // stop sent before the estimated end of the media, us
+
+
+    // batch of expired stop timers, used only by the timer thread
+    std::vector<TimingWheel::Entry> expired_;
+    std::vector<uint32_t>       batch_req_ids_;
+    std::vector<uint8_t>        batch_is_tracked_;
+
+    uint32_t                    sweep_slots_;   // slots of each shard checked per tick, see Config::pending_ttl_ms
+    std::vector<uint32_t>       swept_;         // expired req ids, used only by the timer thread
+
+    // declared last, so that the threads are joined before the state they use is destroyed
+    WorkerPool                  duration_pool_;
+    PeriodicThread              timer_thread_;  // drives the timing wheels
 };
 
 } // namespace simple_voip_wrap